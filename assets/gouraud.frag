@@ -4,13 +4,60 @@ in vec3 ambient_frag;
 in vec3 diffuse_frag;
 in vec3 specular_frag;
 in vec2 tex_coord_frag;
+flat in uvec2 texture_slots_frag;
 
-uniform sampler2D texture_sampler;
-uniform int diffuse_on;
+layout (std140) uniform Frame {
+  mat4 projection_mat;
+  vec3 light_pos;
+  float ambient_intensity;
+  vec3 directional_light;
+  float diffuse_intensity_point;
+  float specular_intensity_point;
+  float diffuse_intensity_directional;
+  float specular_intensity_directional;
+  float znear;
+  float zfar;
+  float cluster_depth_scale;
+  vec2 cluster_tile_scale;
+  float cluster_depth_bias;
+  int cluster_count_x;
+  int cluster_count_y;
+  int cluster_count_z;
+};
+
+struct TextureSlot {
+  vec4 uv_rect;
+  float layer;
+  float max_level;
+  float min_level;
+};
+
+// Where each texture sits in its array, MAX_TEXTURE_SLOTS entries
+layout (std140) uniform TextureSlots {
+  TextureSlot texture_slots[64];
+};
+
+uniform sampler2DArray texture_sampler;
 
 out vec4 FragColor;
 
+// Samples a texture through its slot. UVs wrap inside atlas rectangles, with
+// the level picked from the unwrapped UVs and capped where neighbours would
+// bleed in.
+vec4 sample_slot(sampler2DArray array_sampler, uint slot_index, vec2 uv) {
+  TextureSlot slot = texture_slots[slot_index];
+  vec2 size = vec2(textureSize(array_sampler, 0).xy) * slot.uv_rect.zw;
+  vec2 dx = dFdx(uv) * size, dy = dFdy(uv) * size;
+  float level = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), slot.min_level, slot.max_level);
+  vec2 remapped = slot.uv_rect.xy + fract(uv) * slot.uv_rect.zw;
+  return textureLod(array_sampler, vec3(remapped, slot.layer), level);
+}
+
 void main() {
-  FragColor = vec4(ambient_frag + specular_frag, 1.0) + 
-	(diffuse_on > 0.0 ? vec4(diffuse_frag, 1.0) : vec4(1.0, 1.0, 1.0, 1.0)) * texture(texture_sampler, tex_coord_frag);
+#ifdef DIFFUSE_LIGHTING
+  vec4 diffuse = vec4(diffuse_frag, 1.0);
+#else
+  vec4 diffuse = vec4(1.0, 1.0, 1.0, 1.0);
+#endif
+  FragColor = vec4(ambient_frag + specular_frag, 1.0) + diffuse * sample_slot(texture_sampler, texture_slots_frag.x, tex_coord_frag);
 }
@@ -2,26 +2,52 @@
 
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 normal;
-layout (location = 2) in vec3 mat_ambient;
-layout (location = 3) in vec3 mat_diffuse;
-layout (location = 4) in vec3 mat_specular;
-layout (location = 5) in float mat_shininess;
-layout (location = 6) in vec2 tex_coord;
-
-uniform vec3 light_pos;
-uniform vec3 directional_light;
-uniform float ambient_intensity;
-uniform float diffuse_intensity_point;
-uniform float specular_intensity_point;
-uniform float diffuse_intensity_directional;
-uniform float specular_intensity_directional;
-uniform mat4 projection_mat;
-uniform mat4 modelview_mat;
+layout (location = 3) in vec2 tex_coord;
+layout (location = 4) in uint material_index;
+layout (location = 9) in mat4 modelview_mat;
+// Colour and normal map slots
+layout (location = 13) in uvec2 texture_slots;
+
+layout (std140) uniform Frame {
+  mat4 projection_mat;
+  vec3 light_pos;
+  float ambient_intensity;
+  vec3 directional_light;
+  float diffuse_intensity_point;
+  float specular_intensity_point;
+  float diffuse_intensity_directional;
+  float specular_intensity_directional;
+  float znear;
+  float zfar;
+  float cluster_depth_scale;
+  vec2 cluster_tile_scale;
+  float cluster_depth_bias;
+  int cluster_count_x;
+  int cluster_count_y;
+  int cluster_count_z;
+};
+
+struct Material {
+  vec4 ambient;
+  vec4 diffuse;
+  vec4 specular;
+};
+
+// Shared material table, MAX_MATERIALS entries; shininess in specular.w
+layout (std140) uniform Materials {
+  Material materials[256];
+};
 
 out vec3 ambient_frag;
 out vec3 diffuse_frag;
 out vec3 specular_frag;
 out vec2 tex_coord_frag;
+flat out uvec2 texture_slots_frag;
+
+vec3 mat_ambient;
+vec3 mat_diffuse;
+vec3 mat_specular;
+float mat_shininess;
 
 vec3 diffuse_light(vec3 light_direction, vec3 normal, float intensity) {
   return max(dot(light_direction, normal), 0.0) * intensity * mat_diffuse;
@@ -38,6 +64,12 @@ vec3 specular_light(vec3 light_direction, vec4 pos_modelview, vec3 normal, float
 }
 
 void main() {
+  Material material = materials[material_index];
+  mat_ambient = material.ambient.rgb;
+  mat_diffuse = material.diffuse.rgb;
+  mat_specular = material.specular.rgb;
+  mat_shininess = material.specular.w;
+
   vec4 pos_modelview = modelview_mat * vec4(pos, 1.0);
   gl_Position = projection_mat * pos_modelview;
 
@@ -57,4 +89,5 @@ void main() {
   specular_frag = specular_point + specular_directional;
 
   tex_coord_frag = tex_coord;
+  texture_slots_frag = texture_slots;
 }
@@ -2,26 +2,79 @@
 
 in vec4 pos_modelview_frag;
 in vec3 transformed_normal_frag;
+#ifdef NORMAL_MAP
 in mat3 tbn_frag;
-in vec3 eye_frag;
-in vec3 light_direction_frag;
+#endif
 in vec3 ambient_frag;
+#ifdef POINT_LIGHTS
+in vec3 mat_diffuse_frag;
+in vec3 mat_specular_frag;
+#endif
 in vec3 diffuse_product_point_frag;
 in vec3 diffuse_product_directional_frag;
 in float mat_shininess_frag;
 in vec3 specular_product_point_frag;
 in vec3 specular_product_directional_frag;
 in vec2 tex_coord_frag;
+flat in uvec2 texture_slots_frag;
 
-uniform vec3 light_pos;
-uniform vec3 directional_light;
-uniform sampler2D texture_sampler;
-uniform sampler2D normal_sampler;
-uniform int diffuse_on;
-uniform int normal_mapping_on;
+layout (std140) uniform Frame {
+  mat4 projection_mat;
+  vec3 light_pos;
+  float ambient_intensity;
+  vec3 directional_light;
+  float diffuse_intensity_point;
+  float specular_intensity_point;
+  float diffuse_intensity_directional;
+  float specular_intensity_directional;
+  float znear;
+  float zfar;
+  float cluster_depth_scale;
+  vec2 cluster_tile_scale;
+  float cluster_depth_bias;
+  int cluster_count_x;
+  int cluster_count_y;
+  int cluster_count_z;
+};
+
+struct TextureSlot {
+  vec4 uv_rect;
+  float layer;
+  float max_level;
+  float min_level;
+};
+
+// Where each texture sits in its array, MAX_TEXTURE_SLOTS entries
+layout (std140) uniform TextureSlots {
+  TextureSlot texture_slots[64];
+};
+
+uniform sampler2DArray texture_sampler;
+#ifdef NORMAL_MAP
+uniform sampler2DArray normal_sampler;
+#endif
+#ifdef POINT_LIGHTS
+// Point lights as (position, radius), (color, intensity) texel pairs
+uniform samplerBuffer light_sampler;
+// Offset and count into the light indices, per cluster
+uniform usamplerBuffer cluster_sampler;
+uniform usamplerBuffer light_index_sampler;
+#endif
 
 out vec4 FragColor;
 
+// Samples a texture through its slot. UVs wrap inside atlas rectangles, with
+// the level picked from the unwrapped UVs and capped where neighbours would
+// bleed in.
+vec4 sample_slot(sampler2DArray array_sampler, uint slot_index, vec2 uv) {
+  TextureSlot slot = texture_slots[slot_index];
+  vec2 size = vec2(textureSize(array_sampler, 0).xy) * slot.uv_rect.zw;
+  vec2 dx = dFdx(uv) * size, dy = dFdy(uv) * size;
+  float level = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), slot.min_level, slot.max_level);
+  vec2 remapped = slot.uv_rect.xy + fract(uv) * slot.uv_rect.zw;
+  return textureLod(array_sampler, vec3(remapped, slot.layer), level);
+}
+
 vec3 diffuse_light(vec3 light_direction, vec3 normal, vec3 product) {
   return max(dot(light_direction, normal), 0.0) * product;
 }
@@ -36,26 +89,66 @@ vec3 specular_light(vec3 light_direction, vec4 pos_modelview, vec3 normal, vec3
   return specular;
 }
 
+#ifdef POINT_LIGHTS
+// Sum of the point lights binned into this fragment's cluster
+void clustered_lights(vec3 normal, out vec3 diffuse, out vec3 specular) {
+  diffuse = vec3(0.0, 0.0, 0.0);
+  specular = vec3(0.0, 0.0, 0.0);
+  float ndc_depth = 2.0 * gl_FragCoord.z - 1.0;
+  float view_depth = 2.0 * znear * zfar / (zfar + znear - ndc_depth * (zfar - znear));
+  int slice = clamp(int(log(view_depth) * cluster_depth_scale + cluster_depth_bias), 0, cluster_count_z - 1);
+  ivec2 tile = clamp(ivec2(gl_FragCoord.xy * cluster_tile_scale), ivec2(0, 0), ivec2(cluster_count_x - 1, cluster_count_y - 1));
+  int cluster = (slice * cluster_count_y + tile.y) * cluster_count_x + tile.x;
+  uvec2 range = texelFetch(cluster_sampler, cluster).rg;
+  for (uint i = 0u; i < range.y; i++) {
+    int light = int(texelFetch(light_index_sampler, int(range.x + i)).r);
+    vec4 pos_radius = texelFetch(light_sampler, 2 * light);
+    vec4 color_intensity = texelFetch(light_sampler, 2 * light + 1);
+    vec3 offset = pos_radius.xyz - pos_modelview_frag.xyz;
+    float dist = length(offset);
+    // Inverse square, windowed to reach zero at the radius
+    float window = clamp(1.0 - pow(dist / pos_radius.w, 4.0), 0.0, 1.0);
+    float falloff = window * window / (1.0 + dist * dist);
+    vec3 light_direction = offset / max(dist, 1e-4);
+    vec3 radiance = falloff * color_intensity.a * color_intensity.rgb;
+    diffuse += diffuse_light(light_direction, normal, radiance * mat_diffuse_frag);
+    specular += specular_light(light_direction, pos_modelview_frag, normal, radiance * mat_specular_frag);
+  }
+}
+#endif
+
 void main() {
   vec3 transformed_normal = normalize(transformed_normal_frag);
-  if (normal_mapping_on > 0) {
-    vec3 normal_map = texture(normal_sampler, tex_coord_frag).rgb * 2 - 1;
-    transformed_normal = normalize(-tbn_frag * normal_map);
-  }
-  vec3 eye = normalize(eye_frag);
-  vec3 light_direction = normalize(light_direction_frag);
+#ifdef NORMAL_MAP
+  // Only x and y are stored; z is rebuilt from the unit length
+  vec2 normal_xy = sample_slot(normal_sampler, texture_slots_frag.y, tex_coord_frag).rg * 2 - 1;
+  vec3 normal_map = vec3(normal_xy, sqrt(max(1.0 - dot(normal_xy, normal_xy), 0.0)));
+  transformed_normal = normalize(-tbn_frag * normal_map);
+#endif
+  vec3 light_direction = normalize(light_pos - pos_modelview_frag.xyz);
 
   float inverse_square = 1 / (1 + pow(distance(light_pos, pos_modelview_frag.xyz), 2));
   vec3 diffuse_point = inverse_square * diffuse_light(light_direction, transformed_normal, diffuse_product_point_frag);
   vec3 directional_light_direction = normalize(-directional_light);
   vec3 diffuse_directional = diffuse_light(directional_light_direction, transformed_normal, diffuse_product_directional_frag);
   vec3 diffuse = diffuse_point + diffuse_directional;
+#ifdef POINT_LIGHTS
+  vec3 diffuse_clustered, specular_clustered;
+  clustered_lights(transformed_normal, diffuse_clustered, specular_clustered);
+  diffuse += diffuse_clustered;
+#endif
 
   vec3 specular_point = inverse_square * specular_light(light_direction, pos_modelview_frag, transformed_normal, specular_product_point_frag);
   vec3 specular_directional = specular_light(directional_light_direction, pos_modelview_frag, transformed_normal, specular_product_directional_frag);
   vec3 specular = specular_point + specular_directional;
+#ifdef POINT_LIGHTS
+  specular += specular_clustered;
+#endif
 
-  vec3 shaded = ambient_frag + diffuse + specular;
-  FragColor = vec4(ambient_frag + specular, 1.0) + 
-	(diffuse_on > 0.0 ? vec4(diffuse, 1.0) : vec4(1.0, 1.0, 1.0, 1.0)) * texture(texture_sampler, tex_coord_frag);
+#ifdef DIFFUSE_LIGHTING
+  vec4 diffuse_color = vec4(diffuse, 1.0);
+#else
+  vec4 diffuse_color = vec4(1.0, 1.0, 1.0, 1.0);
+#endif
+  FragColor = vec4(ambient_frag + specular, 1.0) + diffuse_color * sample_slot(texture_sampler, texture_slots_frag.x, tex_coord_frag);
 }
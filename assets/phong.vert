@@ -2,49 +2,85 @@
 
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 normal;
-layout (location = 2) in vec3 mat_ambient;
-layout (location = 3) in vec3 mat_diffuse;
-layout (location = 4) in vec3 mat_specular;
-layout (location = 5) in float mat_shininess;
-layout (location = 6) in vec2 tex_coord;
-layout (location = 7) in vec3 tangent;
-layout (location = 8) in vec3 bitangent;
-
-uniform vec3 light_pos;
-uniform vec3 directional_light;
-uniform float ambient_intensity;
-uniform float diffuse_intensity_point;
-uniform float specular_intensity_point;
-uniform float diffuse_intensity_directional;
-uniform float specular_intensity_directional;
-uniform mat4 projection_mat;
-uniform mat4 modelview_mat;
+// Bitangent handedness in w
+layout (location = 2) in vec4 tangent;
+layout (location = 3) in vec2 tex_coord;
+layout (location = 4) in uint material_index;
+layout (location = 9) in mat4 modelview_mat;
+// Colour and normal map slots
+layout (location = 13) in uvec2 texture_slots;
+
+layout (std140) uniform Frame {
+  mat4 projection_mat;
+  vec3 light_pos;
+  float ambient_intensity;
+  vec3 directional_light;
+  float diffuse_intensity_point;
+  float specular_intensity_point;
+  float diffuse_intensity_directional;
+  float specular_intensity_directional;
+  float znear;
+  float zfar;
+  float cluster_depth_scale;
+  vec2 cluster_tile_scale;
+  float cluster_depth_bias;
+  int cluster_count_x;
+  int cluster_count_y;
+  int cluster_count_z;
+};
+
+struct Material {
+  vec4 ambient;
+  vec4 diffuse;
+  vec4 specular;
+};
+
+// Shared material table, MAX_MATERIALS entries; shininess in specular.w
+layout (std140) uniform Materials {
+  Material materials[256];
+};
 
 out vec4 pos_modelview_frag;
 out vec3 transformed_normal_frag;
+#ifdef NORMAL_MAP
 out mat3 tbn_frag;
-out vec3 eye_frag;
-out vec3 light_direction_frag;
+#endif
 out vec3 ambient_frag;
+#ifdef POINT_LIGHTS
+out vec3 mat_diffuse_frag;
+out vec3 mat_specular_frag;
+#endif
 out vec3 diffuse_product_point_frag;
 out vec3 diffuse_product_directional_frag;
 out float mat_shininess_frag;
 out vec3 specular_product_point_frag;
 out vec3 specular_product_directional_frag;
 out vec2 tex_coord_frag;
+flat out uvec2 texture_slots_frag;
 
 void main() {
+  Material material = materials[material_index];
+  vec3 mat_ambient = material.ambient.rgb;
+  vec3 mat_diffuse = material.diffuse.rgb;
+  vec3 mat_specular = material.specular.rgb;
+  float mat_shininess = material.specular.w;
+
   pos_modelview_frag = modelview_mat * vec4(pos, 1.0);
   gl_Position = projection_mat * pos_modelview_frag;
 
   transformed_normal_frag = normalize(modelview_mat * vec4(normal, 0.0)).xyz;
-  vec3 transformed_tangent = normalize(modelview_mat * vec4(tangent, 0.0)).xyz;
+#ifdef NORMAL_MAP
+  vec3 bitangent = cross(normal, tangent.xyz) * (tangent.w < 0.0 ? -1.0 : 1.0);
+  vec3 transformed_tangent = normalize(modelview_mat * vec4(tangent.xyz, 0.0)).xyz;
   vec3 transformed_bitangent = normalize(modelview_mat * vec4(bitangent, 0.0)).xyz;
   tbn_frag = mat3(transformed_tangent, transformed_bitangent, transformed_normal_frag);
-  light_direction_frag = normalize(light_pos - pos_modelview_frag.xyz);
-  eye_frag = normalize(-pos_modelview_frag.xyz);
+#endif
 
   ambient_frag = ambient_intensity * mat_ambient;
+#ifdef POINT_LIGHTS
+  mat_diffuse_frag = mat_diffuse;
+  mat_specular_frag = mat_specular;
+#endif
   diffuse_product_point_frag = diffuse_intensity_point * mat_diffuse;
   diffuse_product_directional_frag = diffuse_intensity_directional * mat_diffuse;
   mat_shininess_frag = mat_shininess;
@@ -52,4 +88,5 @@ void main() {
   specular_product_directional_frag = specular_intensity_directional * mat_specular;
 
   tex_coord_frag = tex_coord;
+  texture_slots_frag = texture_slots;
 }
@@ -24,11 +24,17 @@
 #include <chrono>
 #include <cstddef>
 #include <iostream>
+#include <memory>
 #include <string>
 
+#include "platform/platform.hpp"
+
 GLuint program_id, vertex_shader_id, fragment_shader_id, vao_id, texture_id;
 std::size_t index_count;
 std::chrono::time_point<std::chrono::system_clock> last_updated;
+std::unique_ptr<platform::Platform> platform_ptr;
+platform::BenchmarkOptions options;
+std::size_t frame_count = 0;
 const GLchar *vertex_shader = R"(#version 330 core
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 color;
@@ -98,12 +104,15 @@ glm::mat4 perspective_with_lookat =
     glm::perspective(glm::radians(40.0f), 1.0f, 0.1f, 5.0f) *
     glm::lookAt(glm::vec3(0, 0, 3), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
 
-void display() {
+bool display() {
   const auto now = std::chrono::system_clock::now();
   const auto duration = now - last_updated;
+  // Benchmark runs advance a fixed 60 Hz so every run draws the same frames
   const auto delta =
-      std::chrono::duration_cast<std::chrono::duration<float>>(duration)
-          .count();
+      options.frames > 0
+          ? frame_count / 60.0f
+          : std::chrono::duration_cast<std::chrono::duration<float>>(duration)
+                .count();
   const auto modelview_mat =
       glm::translate(glm::mat4(1), {0, -0.5, 0}) *
       glm::scale(glm::mat4(1), {0.75, 0.75, 0.75}) *
@@ -122,8 +131,12 @@ void display() {
   glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
   glBindVertexArray(0);
 
-  glutSwapBuffers();
-  glutPostRedisplay();
+  frame_count++;
+  const auto last_frame = options.frames > 0 && frame_count >= options.frames;
+  if (last_frame && !options.dump_path.empty())
+    platform_ptr->write_png(options.dump_path);
+  platform_ptr->swap_buffers();
+  return !last_frame;
 }
 
 int main(int argc, char **argv) {
@@ -143,24 +156,11 @@ int main(int argc, char **argv) {
     std::cout << "TinyObjReader: " << reader.Warning();
   }
 
-  glutInit(&argc, argv);
-#ifdef __APPLE__
-  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | GLUT_MULTISAMPLE |
-                      GLUT_3_2_CORE_PROFILE);
-#else
-  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | GLUT_MULTISAMPLE);
-#endif
-  glutInitWindowSize(512, 512);
-  glutCreateWindow("Teapot");
-
-#ifndef __APPLE__
-  GLenum init_status = glewInit();
-  if (init_status != GLEW_OK) {
-    std::cerr << "GLEW init error: " << glewGetErrorString(init_status)
-              << std::endl;
-    std::exit(1);
-  }
-#endif
+  options = platform::BenchmarkOptions::parse(argc, argv);
+  auto config = options.config("Teapot");
+  config.multisample = true;
+  platform_ptr = platform::create(argc, argv, config);
+
   program_id = glCreateProgram();
 
   vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
@@ -355,6 +355,5 @@ int main(int argc, char **argv) {
   glUniformMatrix4fv(projection_mat_location, 1, GL_FALSE,
                      glm::value_ptr(perspective_with_lookat));
 
-  glutDisplayFunc(display);
-  glutMainLoop();
+  platform_ptr->run(display);
 }
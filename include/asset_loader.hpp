@@ -0,0 +1,111 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Called on the GL thread as each asset of a batch finishes
+using LoadProgress = std::function<void(
+    const std::string &filename, std::size_t finished, std::size_t total)>;
+
+// Worker threads that parse and decode assets. Loaders hand back plain CPU
+// data; creating GL objects from it is left to the calling thread.
+struct AssetLoader {
+  // Kept on the heap so the loader can move while its threads run
+  struct Shared {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    bool stop = false;
+  };
+
+  std::shared_ptr<Shared> shared;
+  std::vector<std::thread> threads;
+  LoadProgress progress;
+
+  AssetLoader() = default;
+  AssetLoader(const AssetLoader &) = delete;
+  AssetLoader(AssetLoader &&) = default;
+  AssetLoader &operator=(const AssetLoader &) = delete;
+  // The running threads would otherwise be overwritten without a join
+  AssetLoader &operator=(AssetLoader &&) = delete;
+  AssetLoader(std::size_t thread_count, const LoadProgress &progress);
+  ~AssetLoader();
+
+  // Tasks still queued when the loader is destroyed are dropped
+  void submit(std::function<void()> task);
+  // Runs load(filename) on the workers for every filename and calls
+  // finish(i, result) here as each one completes. The first exception is
+  // rethrown once every load has returned.
+  template <class Load, class Finish>
+  void load_all(const std::vector<std::string> &filenames, Load load,
+                Finish finish);
+
+  // Every core but the one driving GL
+  static std::size_t default_thread_count();
+};
+
+template <class Load, class Finish>
+void AssetLoader::load_all(const std::vector<std::string> &filenames,
+                           Load load, Finish finish) {
+  using Result = decltype(load(filenames.front()));
+  std::mutex mutex;
+  std::condition_variable done;
+  std::deque<std::pair<std::size_t, Result>> results;
+  std::exception_ptr error;
+  std::size_t failed = 0;
+  for (std::size_t i = 0; i < filenames.size(); i++)
+    submit([&, i]() {
+      try {
+        auto result = load(filenames[i]);
+        std::lock_guard<std::mutex> lock(mutex);
+        results.emplace_back(i, std::move(result));
+        done.notify_one();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+          error = std::current_exception();
+        failed++;
+        done.notify_one();
+      }
+    });
+
+  // Locals above are borrowed by the tasks, so every one is waited for
+  std::size_t finished = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (finished + failed < filenames.size()) {
+    done.wait(lock, [&]() {
+      return !results.empty() || finished + failed == filenames.size();
+    });
+    if (results.empty())
+      break;
+    auto result = std::move(results.front());
+    results.pop_front();
+    finished++;
+    const bool skip = error != nullptr;
+    lock.unlock();
+    std::exception_ptr finish_error;
+    if (!skip) {
+      try {
+        finish(result.first, std::move(result.second));
+        if (progress)
+          progress(filenames[result.first], finished, filenames.size());
+      } catch (...) {
+        finish_error = std::current_exception();
+      }
+    }
+    lock.lock();
+    if (finish_error && !error)
+      error = finish_error;
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_util.hpp"
+
+using AssetId = std::uint64_t;
+
+// FNV-1a of a filename, so that literal names hash at compile time
+constexpr AssetId asset_id(const char *filename) { return fnv1a(filename); }
+
+// Entry of an AssetTable, valid while its generation matches the entry's.
+// Asset only tells apart handles of different tables.
+template <class Asset> struct AssetHandle {
+  std::uint32_t index = 0;
+  // Never zero for a handle taken from a table
+  std::uint32_t generation = 0;
+};
+
+struct Model;
+struct TextureImage;
+using ModelHandle = AssetHandle<Model>;
+using TextureHandle = AssetHandle<TextureImage>;
+
+struct AssetEntry {
+  AssetId id;
+  std::string filename;
+  std::uint32_t generation = 1;
+  std::uint32_t ref_count = 0;
+  bool loaded = false;
+};
+
+// Assets of one kind, registered by filename and addressed by handle. Only
+// acquire() looks anything up by id; handles index the table directly.
+template <class Asset> struct AssetTable {
+  std::vector<AssetEntry> entries;
+  std::unordered_map<AssetId, std::uint32_t> indices;
+
+  AssetTable() = default;
+  AssetTable(const AssetTable &) = default;
+  AssetTable(AssetTable &&) = default;
+  AssetTable &operator=(const AssetTable &) = default;
+  AssetTable &operator=(AssetTable &&) = default;
+
+  // Returns the entry's index, which is also where the asset itself lives
+  std::uint32_t add(const std::string &filename);
+  // Each call takes a reference to the entry
+  AssetHandle<Asset> acquire(AssetId id);
+  // Another reference through a handle already held
+  AssetHandle<Asset> retain(const AssetHandle<Asset> &handle);
+  // Dropping the last reference makes every handle to the entry stale. The
+  // asset itself stays loaded for the next acquire().
+  void release(const AssetHandle<Asset> &handle);
+  std::size_t index(const AssetHandle<Asset> &handle) const;
+};
+
+template <class Asset>
+std::uint32_t AssetTable<Asset>::add(const std::string &filename) {
+  const auto id = asset_id(filename.c_str());
+  if (indices.count(id))
+    throw std::runtime_error("asset id collision: " + filename);
+  const std::uint32_t index = entries.size();
+  entries.push_back({id, filename});
+  indices[id] = index;
+  return index;
+}
+
+template <class Asset>
+AssetHandle<Asset> AssetTable<Asset>::acquire(AssetId id) {
+  const auto it = indices.find(id);
+  if (it == indices.end())
+    throw std::runtime_error("unknown asset id");
+  auto &entry = entries[it->second];
+  entry.ref_count++;
+  return {it->second, entry.generation};
+}
+
+template <class Asset>
+AssetHandle<Asset> AssetTable<Asset>::retain(const AssetHandle<Asset> &handle) {
+  entries[index(handle)].ref_count++;
+  return handle;
+}
+
+template <class Asset>
+void AssetTable<Asset>::release(const AssetHandle<Asset> &handle) {
+  auto &entry = entries[index(handle)];
+  if (--entry.ref_count == 0)
+    entry.generation++;
+}
+
+template <class Asset>
+std::size_t AssetTable<Asset>::index(const AssetHandle<Asset> &handle) const {
+  if (handle.index >= entries.size() ||
+      entries[handle.index].generation != handle.generation)
+    throw std::runtime_error("stale asset handle");
+  return handle.index;
+}
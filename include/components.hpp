@@ -45,7 +45,10 @@ struct WinZone {
 
 struct Car {
   static constexpr float TRUCK_PLATE_DURATION = 0.7f;
-  glm::vec3 vel;
+  static constexpr float HEADLIGHT_RADIUS = 3.0f;
+  static constexpr float HEADLIGHT_INTENSITY = 2.0f;
+  std::size_t row_index;
+  float phase;
   BoundingBox3D model_bb;
 };
 
@@ -3,6 +3,7 @@
 #include "ecs/entities.hpp"
 
 #include <chrono>
+#include <cstdint>
 #include <memory>
 #include <random>
 #include <vector>
@@ -12,11 +13,12 @@ template <class T> class Context;
 
 namespace systems {
 template <class T> class System {
-private:
+protected:
   virtual bool should_apply(Context<T> &ctx, entities::EntityId id);
-  virtual void update_single(Context<T> &ctx, entities::EntityId id) = 0;
+  virtual void update_single(Context<T> &ctx, entities::EntityId id);
   virtual void pre_update(Context<T> &ctx);
   virtual void post_update(Context<T> &ctx);
+  virtual void update_all(Context<T> &ctx);
 
 public:
   virtual void operator()(Context<T> &ctx);
@@ -31,6 +33,7 @@ private:
   std::vector<std::shared_ptr<systems::System<T>>> _systems;
   bool _loop_started;
   std::chrono::time_point<std::chrono::system_clock> _last_updated;
+  float _fixed_delta_time;
   std::random_device _random_device;
   std::mt19937 _random_gen;
 
@@ -47,6 +50,11 @@ public:
   last_updated() const;
   float delta_time() const;
   std::mt19937 &random_gen();
+  // Replays the same random sequence on every run
+  void seed(std::uint32_t value);
+  // Steps every update by a constant time instead of the wall clock; zero
+  // restores real time
+  void set_fixed_delta_time(float seconds);
 
   void update();
 };
@@ -55,7 +63,8 @@ template <class T>
 Context<T>::Context(T &&registry,
                     std::vector<std::shared_ptr<systems::System<T>>> &&systems)
     : _entity_manager(), _registry(std::move(registry)),
-      _systems(std::move(systems)), _loop_started(false), _last_updated(), _random_device() {
+      _systems(std::move(systems)), _loop_started(false), _last_updated(),
+      _fixed_delta_time(0), _random_device() {
   _random_gen = std::mt19937(_random_device());
 }
 
@@ -77,6 +86,8 @@ Context<T>::last_updated() const {
 }
 
 template <class T> float Context<T>::delta_time() const {
+  if (_fixed_delta_time > 0)
+    return _fixed_delta_time;
   const auto now = std::chrono::system_clock::now();
   const auto duration = now - _last_updated;
   return std::chrono::duration_cast<std::chrono::duration<float>>(duration)
@@ -88,6 +99,14 @@ std::mt19937 &Context<T>::random_gen() {
   return _random_gen;
 }
 
+template <class T> void Context<T>::seed(std::uint32_t value) {
+  _random_gen.seed(value);
+}
+
+template <class T> void Context<T>::set_fixed_delta_time(float seconds) {
+  _fixed_delta_time = seconds;
+}
+
 template <class T> void Context<T>::update() {
   const auto now = std::chrono::system_clock::now();
   if (!_loop_started) {
@@ -107,17 +126,22 @@ bool System<T>::should_apply(Context<T> &ctx, entities::EntityId id) {
   return true;
 }
 
+template <class T>
+void System<T>::update_single(Context<T> &ctx, entities::EntityId id) {}
+
 template <class T> void System<T>::pre_update(Context<T> &ctx) {}
 
 template <class T> void System<T>::post_update(Context<T> &ctx) {}
 
-template <class T> void System<T>::operator()(Context<T> &ctx) {
-  pre_update(ctx);
-
+template <class T> void System<T>::update_all(Context<T> &ctx) {
   for (entities::EntityId i = 0; i < ctx.entity_manager().end_id(); i++)
     if (should_apply(ctx, i))
       update_single(ctx, i);
+}
 
+template <class T> void System<T>::operator()(Context<T> &ctx) {
+  pre_update(ctx);
+  update_all(ctx);
   post_update(ctx);
 }
 
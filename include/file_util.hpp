@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+const std::uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+const std::uint64_t FNV_PRIME = 0x100000001b3ull;
+
+// FNV-1a of a NUL-terminated string; constexpr so that literals hash at
+// compile time
+constexpr std::uint64_t fnv1a(const char *data,
+                              std::uint64_t value = FNV_OFFSET_BASIS) {
+  return *data == '\0'
+             ? value
+             : fnv1a(data + 1,
+                     (value ^ static_cast<std::uint8_t>(*data)) * FNV_PRIME);
+}
+
+// FNV-1a of raw bytes
+std::uint64_t fnv1a(std::uint64_t seed, const void *data, std::size_t size);
+// FNV-1a, with the length mixed in so that concatenations cannot collide
+std::uint64_t hash(std::uint64_t seed, const std::string &data);
+
+// Mixes a file's size and modification time into seed, as a cheap check
+// that it has not changed; a missing file mixes in only its absence
+std::uint64_t file_stamp(std::uint64_t seed, const std::string &filename);
+
+// Whole file, read as binary; false if it cannot be opened
+bool read_file(const std::string &filename, std::string &contents);
+// Creates one directory level, doing nothing if it already exists
+void make_directory(const std::string &path);
@@ -0,0 +1,48 @@
+#pragma once
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Persistently mapped buffer with one slot per frame in flight. Each slot is
+// fenced after use so the CPU never writes data the GPU may still be reading.
+// Needs GL_ARB_buffer_storage.
+struct FrameRing {
+  static const std::size_t FRAME_COUNT = 3;
+
+  GLenum target = 0;
+  GLuint buffer_id = 0;
+  std::size_t slot_size = 0;
+  std::size_t slot = 0;
+  std::uint8_t *mapped = nullptr;
+  std::array<GLsync, FRAME_COUNT> fences = {};
+
+  FrameRing() = default;
+  FrameRing(const FrameRing &) = default;
+  FrameRing(FrameRing &&) = default;
+  FrameRing &operator=(const FrameRing &) = default;
+  FrameRing &operator=(FrameRing &&) = default;
+  FrameRing(GLenum target, std::size_t slot_size);
+
+  // Grows the slots to at least size bytes, returns whether the buffer was
+  // recreated
+  bool reserve(std::size_t size);
+  // Waits until the current slot is free and returns its memory
+  void *begin_frame();
+  void end_frame();
+  std::size_t offset() const;
+
+private:
+  void create();
+  void wait(std::size_t slot);
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+
+const GLuint FRAME_UNIFORM_BINDING = 0;
+
+// Mirrors the std140 "Frame" block declared by every shader. Scalars are
+// placed in the padding after each vec3.
+struct FrameUniforms {
+  glm::mat4 projection_mat;
+  glm::vec3 light_pos;
+  float ambient_intensity;
+  glm::vec3 directional_light;
+  float diffuse_intensity_point;
+  float specular_intensity_point;
+  float diffuse_intensity_directional;
+  float specular_intensity_directional;
+  // Light cluster lookup: view depth from gl_FragCoord.z, slice from
+  // log(depth), tile from gl_FragCoord.xy
+  float znear;
+  float zfar;
+  float cluster_depth_scale;
+  glm::vec2 cluster_tile_scale;
+  float cluster_depth_bias;
+  GLint cluster_count_x;
+  GLint cluster_count_y;
+  GLint cluster_count_z;
+};
+
+static_assert(offsetof(FrameUniforms, light_pos) == 64, "std140 layout");
+static_assert(offsetof(FrameUniforms, directional_light) == 80,
+              "std140 layout");
+static_assert(offsetof(FrameUniforms, znear) == 108, "std140 layout");
+static_assert(offsetof(FrameUniforms, cluster_tile_scale) == 120,
+              "std140 layout");
+static_assert(offsetof(FrameUniforms, cluster_count_z) == 140,
+              "std140 layout");
+static_assert(sizeof(FrameUniforms) == 144, "std140 layout");
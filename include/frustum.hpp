@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+
+#include "bounding_box.hpp"
+
+struct CullStats {
+  std::size_t chunks_tested = 0;
+  std::size_t chunks_culled = 0;
+  std::size_t meshes_tested = 0;
+  std::size_t meshes_culled = 0;
+  std::size_t static_batches_drawn = 0;
+};
+
+struct Frustum {
+  std::array<glm::vec4, 6> planes;
+  // Planes transposed into groups of four for the SIMD test, padded with
+  // planes that accept everything
+  alignas(16) float plane_x[8];
+  alignas(16) float plane_y[8];
+  alignas(16) float plane_z[8];
+  alignas(16) float plane_w[8];
+
+  Frustum() = default;
+  Frustum(const Frustum &) = default;
+  Frustum(Frustum &&) = default;
+  Frustum &operator=(const Frustum &) = default;
+  Frustum &operator=(Frustum &&) = default;
+  Frustum(const glm::mat4 &view_projection);
+
+  bool intersect_with(const BoundingBox3D &box) const;
+};
+
+// Bounds of a transformed box, exact for rotations as well
+BoundingBox3D transform_bounds(const BoundingBox3D &box, const glm::mat4 &mat);
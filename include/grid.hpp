@@ -7,5 +7,8 @@
 
 const std::size_t GRID_SIZE = 8;
 const float STEP_SIZE = 2.0f;
+// Rows are grouped into chunks of this size for culling and static batching
+const int MAP_CHUNK_ROWS = 8;
 
 BoundingBox3D grid_to_world(int row1, int col1, int row2, int col2);
+int row_chunk(int row);
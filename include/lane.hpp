@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ecs/entities.hpp"
+
+#include <cstddef>
+#include <vector>
+
+#include "grid.hpp"
+
+const float LANE_MIN_X = -2.0f * GRID_SIZE * STEP_SIZE;
+const float LANE_LENGTH = 3.0f * GRID_SIZE * STEP_SIZE;
+
+struct LaneSlot {
+  ecs::entities::EntityId id;
+  // Position of the car at time zero, normalized to [0, LANE_LENGTH).
+  float phase;
+  // Extent of the car's world bounding box relative to its position.
+  float min_x;
+  float max_x;
+};
+
+struct Lane {
+  float speed;
+  // Sorted by phase, so that range queries are a pair of binary searches.
+  std::vector<LaneSlot> slots;
+  float min_extent;
+  float max_extent;
+
+  Lane();
+  Lane(const Lane &) = default;
+  Lane(Lane &&) = default;
+  Lane(float speed);
+  Lane &operator=(const Lane &) = default;
+  Lane &operator=(Lane &&) = default;
+
+  float add(ecs::entities::EntityId id, float pos_x, float min_x, float max_x);
+  // Times are the absolute simulation clock, kept in double so that long
+  // sessions do not lose the per-frame step.
+  float position(float phase, double time) const;
+  std::vector<ecs::entities::EntityId> query(float xmin, float xmax,
+                                             double time) const;
+
+private:
+  // Distance travelled by time, reduced to [0, LANE_LENGTH) in double.
+  float travelled(double time) const;
+};
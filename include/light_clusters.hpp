@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "bounding_box.hpp"
+#include "components.hpp"
+
+// View-space froxel grid: screen tiles by exponentially spaced depth slices
+const int CLUSTER_COUNT_X = 16;
+const int CLUSTER_COUNT_Y = 9;
+const int CLUSTER_COUNT_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+
+// Texture units of the buffer textures read by the clustered shaders
+const GLuint LIGHT_TEXTURE_UNIT = 2;
+const GLuint CLUSTER_TEXTURE_UNIT = 3;
+const GLuint LIGHT_INDEX_TEXTURE_UNIT = 4;
+
+// Two RGBA32F texels in the light buffer
+struct PointLight {
+  glm::vec3 pos;
+  // Distance at which the light fades out completely
+  float radius;
+  glm::vec3 color;
+  float intensity;
+
+  bool reaches(const BoundingBox3D &bounds) const;
+};
+
+static_assert(sizeof(PointLight) == 32, "two RGBA32F texels");
+
+// Bins point lights into clusters on the CPU. Each cluster gets an offset and
+// count into a shared index list, so a fragment only visits the lights that
+// reach its cluster.
+struct LightClusters {
+  // Projection the cluster bounds were built for
+  float fovy = 0;
+  float aspect_ratio = 0;
+  float znear = 0;
+  float zfar = 0;
+  std::vector<BoundingBox3D> bounds;
+  // Offset and count into indices, per cluster
+  std::vector<GLuint> ranges;
+  std::vector<GLuint> indices;
+  // Cluster and light of every overlap found this frame
+  std::vector<std::pair<GLuint, GLuint>> overlaps;
+  GLuint light_buffer_id = 0;
+  GLuint light_texture_id = 0;
+  GLuint cluster_buffer_id = 0;
+  GLuint cluster_texture_id = 0;
+  GLuint index_buffer_id = 0;
+  GLuint index_texture_id = 0;
+
+  LightClusters() = default;
+  LightClusters(const LightClusters &) = default;
+  LightClusters(LightClusters &&) = default;
+  LightClusters &operator=(const LightClusters &) = default;
+  LightClusters &operator=(LightClusters &&) = default;
+
+  void build(const std::vector<PointLight> &lights, const glm::mat4 &view_mat,
+             const components::CameraConfig &camera);
+  void upload(const std::vector<PointLight> &lights);
+  void bind() const;
+  // Slice of view depth d is log(d) * depth_scale() + depth_bias()
+  float depth_scale() const;
+  float depth_bias() const;
+
+private:
+  void build_bounds(const components::CameraConfig &camera);
+  int slice(float depth) const;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "bounding_box.hpp"
+
+struct MeshBvhNode {
+  BoundingBox3D bounds;
+  // For leaves, the range of triangles covered. For inner nodes, count is
+  // zero and first is the index of the right child; the left child always
+  // follows its parent.
+  std::uint32_t first;
+  std::uint32_t count;
+};
+
+struct MeshBvh {
+  static constexpr std::uint32_t LEAF_SIZE = 4;
+  // Three vertices per triangle, reordered so that every leaf is contiguous
+  std::vector<glm::vec3> triangles;
+  std::vector<MeshBvhNode> nodes;
+
+  MeshBvh() = default;
+  MeshBvh(const MeshBvh &) = default;
+  MeshBvh(MeshBvh &&) = default;
+  MeshBvh(const std::vector<float> &vertices,
+          const std::vector<std::uint32_t> &indices);
+  MeshBvh &operator=(const MeshBvh &) = default;
+  MeshBvh &operator=(MeshBvh &&) = default;
+
+  bool empty() const;
+  // Narrowphase queries, for meshes whose bounds already pass the broadphase
+  // test; both work in the mesh's model space
+  bool intersect_with(const BoundingBox3D &box) const;
+  // Distance along direction to the nearest triangle hit, if any
+  bool raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+               float &distance) const;
+
+private:
+  std::uint32_t build(std::vector<std::uint32_t> &order,
+                      const std::vector<glm::vec3> &centroids,
+                      std::uint32_t first, std::uint32_t count);
+};
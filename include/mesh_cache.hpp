@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "model.hpp"
+
+// Relative to the working directory, next to the OBJ files
+const std::string MESH_CACHE_DIRECTORY = "mesh_cache";
+
+// What a cached mesh was built from
+struct MeshSource {
+  // Of the OBJ and MTL contents
+  std::uint64_t hash = 0;
+  // Of their sizes and modification times, checked first so that unchanged
+  // sources are never read
+  std::uint64_t stamp = 0;
+  std::vector<std::string> libraries;
+};
+
+// Keeps the result of load_obj() on disk as one binary file per model,
+// stamped with the OBJ and MTL sources. Later runs map the file and copy
+// its sections out instead of parsing text.
+struct MeshCache {
+  std::string directory;
+
+  MeshCache() = default;
+  MeshCache(const MeshCache &) = default;
+  MeshCache(MeshCache &&) = default;
+  MeshCache &operator=(const MeshCache &) = default;
+  MeshCache &operator=(MeshCache &&) = default;
+  MeshCache(const std::string &directory);
+
+  MeshData load(const std::string &filename) const;
+
+private:
+  std::string path(const std::string &filename) const;
+  static std::uint64_t stamp(const std::string &filename,
+                             const std::vector<std::string> &libraries);
+  bool read(const std::string &path, MeshSource &source,
+            MeshData &data) const;
+  void write(const std::string &path, const MeshSource &source,
+             const MeshData &data) const;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Levels of detail per model, including the full resolution mesh
+const std::size_t LOD_COUNT = 4;
+// Each simplified level targets this fraction of the previous one's triangles
+const float LOD_REDUCTION = 0.4f;
+// Projected size, as a fraction of the screen height, below which level i+1
+// replaces level i
+const std::array<float, LOD_COUNT - 1> LOD_SCREEN_SIZES = {0.25f, 0.12f,
+                                                          0.05f};
+// Relative margin around each threshold, so objects hovering near it keep
+// their level instead of popping back and forth
+const float LOD_HYSTERESIS = 0.15f;
+
+// Quadric error metric edge collapse over an indexed triangle list. Vertices
+// are collapsed onto their neighbours and never moved, so the result indexes
+// the same vertex buffer. Vertices flagged as locked, and those on open
+// boundaries, are kept in place.
+std::vector<GLuint> simplify_mesh(const std::vector<glm::vec3> &positions,
+                                  const std::vector<GLuint> &indices,
+                                  const std::vector<bool> &locked,
+                                  std::size_t target_index_count);
+
+// Picks the level for an object covering screen_size of the screen height,
+// starting from the level it had last frame
+std::size_t select_lod(std::size_t current, std::size_t level_count,
+                       float screen_size);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+
+// Post-transform cache entries assumed when ordering and measuring triangles
+const std::size_t VERTEX_CACHE_SIZE = 16;
+
+// Average cache miss ratio: transformed vertices per triangle under a FIFO
+// cache of cache_size entries. 0.5 is the ideal for large regular meshes,
+// 3 means no reuse at all.
+float acmr(const std::vector<GLuint> &indices, std::size_t vertex_count,
+           std::size_t cache_size = VERTEX_CACHE_SIZE);
+
+// Tipsify (Sander et al. 2007) triangle order for the post-transform cache,
+// followed by its overdraw pass: the runs it emits between dead ends are
+// sorted so that clusters facing away from the mesh centre come first and
+// occlude what lies behind them.
+std::vector<GLuint> optimize_triangle_order(
+    const std::vector<glm::vec3> &positions, const std::vector<GLuint> &indices,
+    std::size_t cache_size = VERTEX_CACHE_SIZE);
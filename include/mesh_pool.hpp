@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+
+#include "uniform_buffer.hpp"
+#include "vertex_format.hpp"
+
+// Layout of glMultiDrawElementsIndirect commands
+struct IndirectCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+// Per-instance attributes: model-view matrix at 9 to 12, then the colour and
+// normal map slots at 13
+struct Instance {
+  glm::mat4 mat;
+  GLuint texture;
+  GLuint normal;
+};
+
+struct MeshRange {
+  GLuint first_index = 0;
+  GLuint index_count = 0;
+  GLint base_vertex = 0;
+
+  IndirectCommand command(GLuint instance_count, GLuint base_instance) const;
+};
+
+// Vertices and indices of every model sub-allocated from one buffer pair,
+// so that all of them can be drawn from a single VAO
+struct MeshPool {
+  GLuint vao_id = 0;
+  GLuint vertex_buffer_id = 0;
+  GLuint index_buffer_id = 0;
+  GLuint instance_buffer_id = 0;
+  // Half float positions unless some model reaches past HALF_POSITION_EXTENT
+  PositionFormat position_format = PositionFormat::HALF;
+  // CPU copies, read back when static geometry is merged
+  std::vector<MeshVertex> vertices;
+  std::vector<GLuint> indices;
+  // Material table shared by every model, indexed per vertex
+  std::vector<Material> materials;
+  UniformBuffer material_uniforms;
+
+  MeshPool() = default;
+  MeshPool(const MeshPool &) = default;
+  MeshPool(MeshPool &&) = default;
+  MeshPool &operator=(const MeshPool &) = default;
+  MeshPool &operator=(MeshPool &&) = default;
+
+  MeshRange add(const std::vector<MeshVertex> &vertices,
+                const std::vector<GLuint> &indices);
+  // Adds indices into the vertices of an existing range
+  MeshRange add(const MeshRange &base, const std::vector<GLuint> &indices);
+  // Appends to the material table, returning the index of the first one
+  GLuint add_materials(const std::vector<Material> &materials);
+  void upload();
+  // Points the instance attributes at another buffer or offset
+  void bind_instances(GLuint buffer_id, std::size_t offset) const;
+
+  // Instance attribute setup shared by every VAO, applied to the bound VAO
+  static void bind_instance_layout(GLuint buffer_id, std::size_t offset);
+};
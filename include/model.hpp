@@ -1,7 +1,5 @@
 #pragma once
 
-#include <tiny_obj_loader.h>
-
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
 
@@ -12,22 +10,46 @@
 #include <GL/glut.h>
 #endif
 
-#include <cstddef>
+#include <string>
 #include <vector>
 
 #include <bounding_box.hpp>
 
+#include "mesh_bvh.hpp"
+#include "mesh_pool.hpp"
+#include "vertex_format.hpp"
+
+// Everything built from an OBJ file before it joins the mesh pool. Vertex
+// material indices refer to the model's own material table.
+struct MeshData {
+  std::vector<Material> materials;
+  std::vector<MeshVertex> vertices;
+  // Indices from full resolution down to the coarsest level
+  std::vector<std::vector<GLuint>> lods;
+  BoundingBox3D bounding_box;
+  MeshBvh bvh;
+  float acmr_before = 0;
+  float acmr_after = 0;
+};
+
+// Parses an OBJ file, welds its vertices, builds tangents, LODs and the BVH,
+// and orders triangles for the post-transform cache
+MeshData load_obj(const std::string &filename);
+
 struct Model {
-  GLuint vao_id;
+  // Index ranges from full resolution down to the coarsest level
+  std::vector<MeshRange> lods;
   BoundingBox3D bounding_box;
-  std::size_t index_count;
+  MeshBvh bvh;
+  // Vertices transformed per triangle of the full mesh, in file order and
+  // after reordering for the post-transform cache
+  float acmr_before = 0;
+  float acmr_after = 0;
 
   Model() = default;
   Model(const Model &) = default;
   Model(Model &&) = default;
   Model &operator=(const Model &) = default;
   Model &operator=(Model &&) = default;
-  Model(const tinyobj::attrib_t &attrib,
-        const std::vector<tinyobj::shape_t> &shapes,
-        const std::vector<tinyobj::material_t> &materials);
+  Model(const MeshData &data, MeshPool &pool);
 };
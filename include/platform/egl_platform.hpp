@@ -0,0 +1,33 @@
+#pragma once
+
+#include <EGL/egl.h>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <functional>
+
+#include "platform/platform.hpp"
+
+namespace platform {
+// Surfaceless EGL context drawing into a framebuffer object, so runs need
+// neither a window system nor a GPU (Mesa llvmpipe works)
+class EglPlatform : public Platform {
+private:
+  EGLDisplay _display;
+  EGLContext _context;
+  GLuint _framebuffer_id;
+  GLuint _color_buffer_id;
+  GLuint _depth_buffer_id;
+
+public:
+  EglPlatform(const Config &config);
+  ~EglPlatform() override;
+
+  void run(const std::function<bool()> &frame) override;
+  void swap_buffers() override;
+};
+} // namespace platform
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+
+#include "platform/platform.hpp"
+
+namespace platform {
+// Double-buffered GLUT window; only one may exist per process
+class GlutPlatform : public Platform {
+private:
+  static std::function<bool()> _frame;
+  static std::function<void(unsigned char)> _key_handler;
+  static std::function<void(int)> _special_key_handler;
+
+  static void display();
+  static void idle();
+  static void keyboard(unsigned char key, int x, int y);
+  static void special(int key, int x, int y);
+
+public:
+  GlutPlatform(int &argc, char **argv, const Config &config);
+
+  void run(const std::function<bool()> &frame) override;
+  void swap_buffers() override;
+  void on_key(const std::function<void(unsigned char)> &handler) override;
+  void on_special_key(const std::function<void(int)> &handler) override;
+};
+} // namespace platform
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace platform {
+struct Config {
+  std::string title;
+  int width = 512;
+  int height = 512;
+  bool multisample = false;
+  // Render into an offscreen framebuffer without a window
+  bool headless = false;
+};
+
+// Owns the GL context and drives the frame loop, either through a GLUT
+// window or offscreen
+class Platform {
+protected:
+  int _width;
+  int _height;
+
+public:
+  Platform(int width, int height);
+  Platform(const Platform &) = delete;
+  virtual ~Platform();
+
+  int width() const;
+  int height() const;
+
+  // Calls frame until it returns false
+  virtual void run(const std::function<bool()> &frame) = 0;
+  virtual void swap_buffers() = 0;
+  virtual void on_key(const std::function<void(unsigned char)> &handler);
+  virtual void on_special_key(const std::function<void(int)> &handler);
+
+  // Rows of RGBA pixels top to bottom, read from the frame being drawn
+  std::vector<std::uint8_t> read_pixels() const;
+  void write_png(const std::string &path) const;
+};
+
+std::unique_ptr<Platform> create(int &argc, char **argv,
+                                 const Config &config);
+
+// Options shared by every benchmarkable program:
+//   --headless, --size WxH, --frames N, --seed S, --dump PATH
+// Unrecognised arguments are left in place.
+struct BenchmarkOptions {
+  bool headless = false;
+  int width = 512;
+  int height = 512;
+  // Zero runs until the window is closed
+  std::size_t frames = 0;
+  std::uint32_t seed = 0;
+  bool seeded = false;
+  // PNG written from the last frame
+  std::string dump_path;
+
+  static BenchmarkOptions parse(int &argc, char **argv);
+  Config config(const std::string &title) const;
+};
+} // namespace platform
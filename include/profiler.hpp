@@ -0,0 +1,125 @@
+#pragma once
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Fixed-width histogram of durations in milliseconds
+struct TimeHistogram {
+  static constexpr float BUCKET_MS = 0.05f;
+  static constexpr std::size_t BUCKET_COUNT = 2000;
+
+  std::vector<std::uint32_t> buckets;
+  std::size_t count = 0;
+  float max = 0.0f;
+  float total = 0.0f;
+
+  TimeHistogram();
+  TimeHistogram(const TimeHistogram &) = default;
+  TimeHistogram(TimeHistogram &&) = default;
+  TimeHistogram &operator=(const TimeHistogram &) = default;
+  TimeHistogram &operator=(TimeHistogram &&) = default;
+
+  void add(float ms);
+  // Upper edge of the bucket holding the p-th percentile, p in [0, 1]
+  float percentile(float p) const;
+  float mean() const;
+  void clear();
+};
+
+// Per-frame counts of something, such as the objects culled
+struct CountStats {
+  std::size_t count = 0;
+  std::size_t max = 0;
+  std::size_t total = 0;
+
+  CountStats() = default;
+  CountStats(const CountStats &) = default;
+  CountStats(CountStats &&) = default;
+  CountStats &operator=(const CountStats &) = default;
+  CountStats &operator=(CountStats &&) = default;
+
+  void add(std::size_t value);
+  float mean() const;
+};
+
+// GL_TIME_ELAPSED queries kept in flight for a few frames, so reading a
+// result never stalls on the GPU
+struct GpuTimer {
+  static const std::size_t QUERY_COUNT = 4;
+
+  std::array<GLuint, QUERY_COUNT> queries = {};
+  std::array<std::size_t, QUERY_COUNT> frames = {};
+  std::array<bool, QUERY_COUNT> pending = {};
+  std::size_t next = 0;
+  std::size_t oldest = 0;
+  bool active = false;
+
+  GpuTimer() = default;
+  GpuTimer(const GpuTimer &) = default;
+  GpuTimer(GpuTimer &&) = default;
+  GpuTimer &operator=(const GpuTimer &) = default;
+  GpuTimer &operator=(GpuTimer &&) = default;
+
+  // Skips the sample while every query is still pending
+  void begin(std::size_t frame);
+  void end();
+  // Reads the oldest finished query if there is one
+  bool poll(float &ms, std::size_t &frame);
+};
+
+struct Profiler {
+  using Clock = std::chrono::steady_clock;
+
+  std::size_t frame = 0;
+  TimeHistogram frame_times;
+  std::map<std::string, TimeHistogram> cpu_times;
+  std::map<std::string, TimeHistogram> gpu_times;
+  std::map<std::string, GpuTimer> gpu_timers;
+  std::map<std::string, CountStats> counts;
+  // Samples of the frame in progress, and the GPU samples that resolved
+  // during it, summed per earlier frame they belong to
+  std::map<std::string, float> frame_cpu;
+  std::map<std::string, std::size_t> frame_counts;
+  std::map<std::string, std::map<std::size_t, float>> frame_gpu;
+  std::shared_ptr<std::ofstream> csv;
+  std::vector<std::string> csv_cpu_columns;
+  std::vector<std::string> csv_count_columns;
+  std::vector<std::string> csv_gpu_columns;
+  Clock::time_point last_frame;
+  bool started = false;
+
+  Profiler() = default;
+  Profiler(const Profiler &) = default;
+  Profiler(Profiler &&) = default;
+  Profiler &operator=(const Profiler &) = default;
+  Profiler &operator=(Profiler &&) = default;
+
+  void record_cpu(const std::string &name, float ms);
+  void record_count(const std::string &name, std::size_t value);
+  void begin_gpu(const std::string &name);
+  void end_gpu(const std::string &name);
+  void end_frame();
+  void open_csv(const std::string &path);
+  std::string report() const;
+  void clear();
+
+private:
+  void write_csv_row(float frame_ms);
+};
@@ -3,17 +3,31 @@
 #include "ecs/entities.hpp"
 #include "ecs/systems.hpp"
 
+#include <array>
 #include <cstddef>
 #include <queue>
 #include <random>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "asset_loader.hpp"
+#include "asset_manager.hpp"
 #include "components.hpp"
+#include "frustum.hpp"
+#include "lane.hpp"
+#include "light_clusters.hpp"
+#include "mesh_pool.hpp"
 #include "model.hpp"
+#include "profiler.hpp"
+#include "row_index.hpp"
 #include "shader_program.hpp"
-#include "texture.hpp"
+#include "static_batcher.hpp"
+#include "texture_array.hpp"
+#include "texture_streamer.hpp"
+#include "trigger_grid.hpp"
+#include "uniform_buffer.hpp"
 
 enum class GameState { IN_PROGRESS, LOSE, WIN };
 
@@ -21,8 +35,24 @@ enum class InputKind { UP, DOWN, LEFT, RIGHT };
 
 enum class TileType { ROAD, GRASS };
 
+// What the scene spawns, acquired once at startup so that spawning and
+// rendering never look an asset up by name
+struct SceneAssets {
+  ModelHandle rooster, tree, car, truck, sneakers, floor;
+  TextureHandle rooster_texture, tree_texture, car_texture, truck_texture,
+      ground_texture, road_texture, empty_texture;
+  TextureHandle empty_normal, ground_normal, road_normal;
+};
+
+// Assets a mesh entity holds a reference to for as long as it exists
+struct MeshAssets {
+  ModelHandle model;
+  TextureHandle texture, normal;
+};
+
 struct Registry {
   std::unordered_map<ecs::entities::EntityId, components::Mesh> meshes;
+  std::unordered_map<ecs::entities::EntityId, MeshAssets> mesh_assets;
   std::unordered_map<ecs::entities::EntityId, components::Character> characters;
   std::unordered_map<ecs::entities::EntityId, components::ActionRestriction>
       action_restrictions;
@@ -32,11 +62,15 @@ struct Registry {
   std::unordered_map<ecs::entities::EntityId, components::ShoeItem> shoe_items;
   std::unordered_set<ecs::entities::EntityId> wheels;
   std::unordered_set<ecs::entities::EntityId> truck_plates;
+  std::unordered_map<std::size_t, Lane> lanes;
 
   GameState state = GameState::IN_PROGRESS;
+  double sim_time = 0.0;
   ecs::entities::EntityId character_id;
   std::queue<InputKind> input_queue;
-  std::unordered_set<components::ActionKind> blocked_actions;
+  // Actions blocked in the current cell, mapped to whether they stay blocked
+  // in pass-through mode
+  std::unordered_map<components::ActionKind, bool> blocked_actions;
   bool pass_through = false;
   bool diffuse_on = true;
   bool normal_mapping_on = true;
@@ -47,25 +81,59 @@ struct Registry {
       glm::vec3(), glm::vec3(), 0, 3, 1, 4, 1,
   };
   float directional_light_angle = 0.0f;
+  int viewport_width = 512;
+  int viewport_height = 512;
+  // Threads for model and texture loads, declared before what they fill
+  AssetLoader asset_loader;
   const std::vector<std::string> model_filenames = {
       "rooster.obj",  "tree.obj",  "car.obj",   "truck.obj",
       "sneakers.obj", "floor.obj", "floor2.obj"};
-  std::unordered_map<std::string, std::size_t> model_indices;
+  // Indexed like model_filenames; models nothing acquired stay empty
+  AssetTable<Model> model_assets;
   std::vector<Model> models;
+  MeshPool mesh_pool;
+  // Floors and trees, which never move once placed
+  StaticBatcher static_batcher;
   const std::vector<std::string> texture_filenames = {
       "empty_texture.png", "rooster_texture.jpg", "tree_texture.png",
       "car_texture.png",   "truck_texture.jpg",   "ground_texture.jpg",
       "road_texture.jpg"};
   const std::vector<std::string> normal_filenames = {
       "empty_normal.png", "ground_normal.jpg", "road_normal.png"};
-  std::unordered_map<std::string, std::size_t> texture_indicies;
-  std::vector<Texture> textures;
+  // Colour maps, then normal maps
+  AssetTable<TextureImage> texture_assets;
+  TextureArrays texture_arrays;
+  // Fills texture_arrays in the background
+  TextureStreamer texture_streamer;
+  SceneAssets scene_assets;
 
   static constexpr std::size_t GOURAUD_SHADER = 0, PHONG_SHADER = 1;
+  // Features each shader reacts to; a variant is built for every subset
+  const std::vector<unsigned int> shader_features = {
+      DIFFUSE_LIGHTING_FEATURE,
+      NORMAL_MAP_FEATURE | DIFFUSE_LIGHTING_FEATURE | POINT_LIGHTS_FEATURE};
   std::vector<ShaderProgram> shader_programs;
-  std::size_t program_index = GOURAUD_SHADER;
+  // Index into shader_programs for each shader and feature combination
+  std::vector<std::array<std::size_t, FEATURE_COMBINATIONS>> shader_variants;
+  std::size_t shader_index = GOURAUD_SHADER;
+  // Multi-draw-indirect submission, used when the driver supports it
+  bool indirect_supported = false;
+  bool indirect_draw = false;
+  UniformBuffer frame_uniforms;
+  CullStats cull_stats;
+  Profiler profiler;
 
   std::size_t player_row = 0;
+  int player_col = 0;
+  std::pair<int, int> character_cell = {-1, -1};
+  TriggerGrid triggers;
+  RowIndex map_rows;
+  int activity_rows_behind = 8;
+  int activity_rows_ahead = 32;
+  int activity_row = -1;
+  std::size_t activity_version = 0;
+  std::vector<ecs::entities::EntityId> awake_ids;
+  std::unordered_map<ecs::entities::EntityId, double> sleep_times;
   std::size_t score = 0;
   std::size_t map_top_generated = 1;
   bool map_generate_finished = false;
@@ -84,10 +152,21 @@ struct Registry {
   std::uniform_real_distribution<double> random_probability_dist =
       std::uniform_real_distribution<double>(0.0, 1.0);
 
-  Registry();
+  Registry(const LoadProgress &progress);
+
+  // Take a reference, loading the asset on first use. Models load with the
+  // startup batch, so a model first acquired after it throws.
+  ModelHandle acquire_model(AssetId id);
+  TextureHandle acquire_texture(AssetId id);
+
+  // Program of the current shader specialised for the given features
+  std::size_t program_index(unsigned int features) const;
 
+  // The mesh keeps a reference to each of its assets until remove_mesh()
   ecs::entities::EntityId add_mesh(ecs::Context<Registry> &ctx,
-                                   components::Mesh &&mesh);
+                                   const MeshAssets &assets,
+                                   const glm::mat4 &mat);
+  void remove_mesh(ecs::entities::EntityId id);
   TileType random_tile_type(ecs::Context<Registry> &ctx);
   int random_tile_length(ecs::Context<Registry> &ctx);
   int random_column(ecs::Context<Registry> &ctx);
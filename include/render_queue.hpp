@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_pool.hpp"
+
+// Sort key layout, most significant first:
+//   pass (2) | program (4) | texture (8) | normal (8) | model (8) | lod (2) |
+//   depth (32)
+// Texture and normal are the texture arrays bound, not the textures within
+// them. Everything above the depth bits is the GL state a packet needs, so
+// packets that can share a draw call end up adjacent, ordered front to back.
+struct RenderKey {
+  static constexpr int DEPTH_BITS = 32, LOD_BITS = 2, MODEL_BITS = 8,
+                       NORMAL_BITS = 8, TEXTURE_BITS = 8, PROGRAM_BITS = 4,
+                       PASS_BITS = 2;
+  static constexpr int LOD_SHIFT = DEPTH_BITS,
+                       MODEL_SHIFT = LOD_SHIFT + LOD_BITS,
+                       NORMAL_SHIFT = MODEL_SHIFT + MODEL_BITS,
+                       TEXTURE_SHIFT = NORMAL_SHIFT + NORMAL_BITS,
+                       PROGRAM_SHIFT = TEXTURE_SHIFT + TEXTURE_BITS,
+                       PASS_SHIFT = PROGRAM_SHIFT + PROGRAM_BITS;
+  static_assert(PASS_SHIFT + PASS_BITS == 64, "key must fill 64 bits");
+  static constexpr std::size_t OPAQUE_PASS = 0;
+
+  static std::uint64_t make(std::size_t pass, std::size_t program,
+                            std::size_t texture, std::size_t normal,
+                            std::size_t model, std::size_t lod, float depth);
+  static std::uint64_t state(std::uint64_t key);
+  static std::size_t pass(std::uint64_t key);
+  static std::size_t program(std::uint64_t key);
+  static std::size_t texture(std::uint64_t key);
+  static std::size_t normal(std::uint64_t key);
+  static std::size_t model(std::uint64_t key);
+  static std::size_t lod(std::uint64_t key);
+};
+
+struct DrawPacket {
+  std::uint64_t key;
+  std::uint32_t instance;
+};
+
+struct RenderQueue {
+  std::vector<DrawPacket> packets;
+  std::vector<Instance> instances;
+
+  RenderQueue() = default;
+  RenderQueue(const RenderQueue &) = default;
+  RenderQueue(RenderQueue &&) = default;
+  RenderQueue &operator=(const RenderQueue &) = default;
+  RenderQueue &operator=(RenderQueue &&) = default;
+
+  void push(std::uint64_t key, const Instance &instance);
+  void sort();
+  void clear();
+
+private:
+  std::vector<DrawPacket> scratch;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "ecs/entities.hpp"
+
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct RowIndex {
+  std::map<int, std::vector<ecs::entities::EntityId>> rows;
+  std::unordered_map<ecs::entities::EntityId, std::pair<int, int>> spans;
+  // Bumped on every change so that cached queries can be invalidated
+  std::size_t version = 0;
+
+  RowIndex() = default;
+  RowIndex(const RowIndex &) = default;
+  RowIndex(RowIndex &&) = default;
+  RowIndex &operator=(const RowIndex &) = default;
+  RowIndex &operator=(RowIndex &&) = default;
+
+  void insert(ecs::entities::EntityId id, int row_lo, int row_hi);
+  void remove(ecs::entities::EntityId id);
+  std::vector<ecs::entities::EntityId> query(int row_lo, int row_hi) const;
+};
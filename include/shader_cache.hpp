@@ -0,0 +1,66 @@
+#pragma once
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "shader_program.hpp"
+
+// Relative to the working directory, next to the shader sources
+const std::string SHADER_CACHE_DIRECTORY = "shader_cache";
+
+// Builds shader programs, reusing linked binaries saved by earlier runs.
+// Programs are requested first and collected together, so that the driver
+// can compile cache misses in parallel while the caller does other work.
+struct ShaderCache {
+  struct Pending {
+    std::string vertex_shader_filename;
+    std::string fragment_shader_filename;
+    std::string vertex_source;
+    std::string fragment_source;
+    std::uint64_t key;
+    GLuint program_id;
+    GLuint vertex_shader_id;
+    GLuint fragment_shader_id;
+    bool from_binary;
+  };
+
+  std::string directory;
+  // Driver identification mixed into every key, since binaries are only
+  // valid for the driver that produced them
+  std::string driver;
+  bool binaries_supported = false;
+  std::vector<Pending> pending;
+
+  ShaderCache() = default;
+  ShaderCache(const ShaderCache &) = default;
+  ShaderCache(ShaderCache &&) = default;
+  ShaderCache &operator=(const ShaderCache &) = default;
+  ShaderCache &operator=(ShaderCache &&) = default;
+  ShaderCache(const std::string &directory);
+
+  // Starts building a program and returns its index in finish()
+  std::size_t request(const std::string &vertex_shader_filename,
+                      const std::string &fragment_shader_filename,
+                      const std::vector<std::string> &defines = {});
+  // Waits for every requested program and saves the new binaries
+  std::vector<ShaderProgram> finish();
+
+private:
+  std::string path(std::uint64_t key) const;
+  bool load_binary(Pending &program) const;
+  void save_binary(const Pending &program) const;
+  void compile(Pending &program) const;
+  void link(Pending &program) const;
+};
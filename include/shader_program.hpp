@@ -1,5 +1,7 @@
 #pragma once
 
+#include <glm/glm.hpp>
+
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
 
@@ -10,10 +12,46 @@
 #include <GL/glut.h>
 #endif
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
+
+// Features compiled into program variants as #defines, so that shaders
+// select them without branching at runtime
+const unsigned int NORMAL_MAP_FEATURE = 1;
+const unsigned int DIFFUSE_LIGHTING_FEATURE = 2;
+const unsigned int POINT_LIGHTS_FEATURE = 4;
+const unsigned int FEATURE_COMBINATIONS = 8;
+
+std::vector<std::string> feature_defines(unsigned int features);
+// Inserts a #define for each name right after the #version line
+std::string inject_defines(const std::string &source,
+                           const std::vector<std::string> &defines);
+
+struct ShaderVariable {
+  std::string name;
+  GLint location;
+  GLenum type;
+  GLint size;
+};
+
+// Handle to a uniform of a specific program, resolved once by name
+template <class T> struct Uniform {
+  std::size_t index = static_cast<std::size_t>(-1);
+  GLint location = -1;
+};
 
 struct ShaderProgram {
   GLuint program_id;
+  // Sorted by name
+  std::vector<ShaderVariable> uniforms;
+  std::vector<ShaderVariable> attributes;
+  // Last uploaded value of each uniform, used to drop redundant uploads
+  std::vector<std::array<std::uint8_t, sizeof(glm::mat4)>> uniform_values;
+  std::vector<bool> uniform_valid;
 
   ShaderProgram() = default;
   ShaderProgram(const ShaderProgram &) = default;
@@ -22,4 +60,31 @@ struct ShaderProgram {
   ShaderProgram &operator=(ShaderProgram &&) = default;
   ShaderProgram(const std::string &vertex_shader_filename,
                 const std::string &fragment_shader_filename);
+  // Takes over an already linked program
+  explicit ShaderProgram(GLuint program_id);
+
+  template <class T> Uniform<T> uniform(const std::string &name) const;
+  GLint attribute_location(const std::string &name) const;
+  void bind_uniform_block(const std::string &name, GLuint binding) const;
+
+  // The program must be in use when calling these
+  void set(const Uniform<float> &uniform, float value);
+  void set(const Uniform<int> &uniform, int value);
+  void set(const Uniform<bool> &uniform, bool value);
+  void set(const Uniform<glm::vec3> &uniform, const glm::vec3 &value);
+  void set(const Uniform<glm::mat4> &uniform, const glm::mat4 &value);
+
+private:
+  void reflect();
+  bool update_cache(std::size_t index, const void *value, std::size_t size);
 };
+
+template <class T>
+Uniform<T> ShaderProgram::uniform(const std::string &name) const {
+  const auto it = std::lower_bound(
+      uniforms.begin(), uniforms.end(), name,
+      [](const ShaderVariable &v, const std::string &n) { return v.name < n; });
+  if (it == uniforms.end() || it->name != name)
+    return {};
+  return {static_cast<std::size_t>(it - uniforms.begin()), it->location};
+}
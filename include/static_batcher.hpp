@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ecs/entities.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "bounding_box.hpp"
+#include "components.hpp"
+#include "mesh_pool.hpp"
+#include "model.hpp"
+
+// Pre-transformed geometry of one chunk sharing a texture pair
+struct StaticBatch {
+  std::size_t texture_index;
+  std::size_t normal_index;
+  MeshRange range;
+};
+
+struct StaticChunk {
+  std::vector<ecs::entities::EntityId> ids;
+  BoundingBox3D bounds;
+  // Until built, the meshes are drawn one by one
+  bool built = false;
+  GLuint vao_id = 0;
+  GLuint vertex_buffer_id = 0;
+  GLuint index_buffer_id = 0;
+  // One identity instance per batch, carrying its texture slots
+  GLuint instance_buffer_id = 0;
+  std::vector<StaticBatch> batches;
+};
+
+// Merges meshes that never move into one vertex/index buffer per chunk of
+// map rows, drawn with one call per texture pair
+struct StaticBatcher {
+  std::map<int, StaticChunk> chunks;
+  // Bumped on every change so that cached bounds can be invalidated
+  std::size_t version = 0;
+
+  StaticBatcher() = default;
+  StaticBatcher(const StaticBatcher &) = default;
+  StaticBatcher(StaticBatcher &&) = default;
+  StaticBatcher &operator=(const StaticBatcher &) = default;
+  StaticBatcher &operator=(StaticBatcher &&) = default;
+
+  void add(ecs::entities::EntityId id, int row, const BoundingBox3D &bounds);
+  void build(int chunk,
+             const std::unordered_map<ecs::entities::EntityId,
+                                      components::Mesh> &meshes,
+             const std::vector<Model> &models, const MeshPool &pool);
+  // Releases the merged buffers and forgets the chunk's meshes
+  void unload(int chunk);
+};
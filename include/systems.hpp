@@ -5,12 +5,96 @@
 
 #include <glm/glm.hpp>
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bounding_box.hpp"
 #include "components.hpp"
+#include "frame_ring.hpp"
+#include "frustum.hpp"
+#include "light_clusters.hpp"
 #include "registry.hpp"
+#include "render_queue.hpp"
+#include "shader_program.hpp"
+#include "static_batcher.hpp"
 
 namespace systems {
+// Runs another system and records its CPU time in the profiler
+class Timed : public ecs::systems::System<Registry> {
+private:
+  std::string name;
+  std::shared_ptr<ecs::systems::System<Registry>> system;
+
+  void update_single(ecs::Context<Registry> &ctx,
+                     ecs::entities::EntityId id) override;
+
+public:
+  Timed(const std::string &name, ecs::systems::System<Registry> *system);
+
+  void operator()(ecs::Context<Registry> &ctx) override;
+};
+
+// Base for systems that only tick entities awake in the activity region
+class RegionSystem : public ecs::systems::System<Registry> {
+protected:
+  void update_all(ecs::Context<Registry> &ctx) override;
+};
+
+class Activity : public ecs::systems::System<Registry> {
+private:
+  void collect_subtree(ecs::Context<Registry> &ctx, ecs::entities::EntityId id,
+                       std::vector<ecs::entities::EntityId> &ids);
+
+  void wake(ecs::Context<Registry> &ctx, ecs::entities::EntityId id);
+
+public:
+  void operator()(ecs::Context<Registry> &ctx) override;
+};
+
 class Render : public ecs::systems::System<Registry> {
 private:
+  struct Uniforms {
+    Uniform<int> texture_sampler;
+    Uniform<int> normal_sampler;
+    Uniform<int> light_sampler;
+    Uniform<int> cluster_sampler;
+    Uniform<int> light_index_sampler;
+  };
+
+  static const std::size_t INITIAL_RING_INSTANCES = 4096;
+
+  std::vector<Uniforms> program_uniforms;
+  RenderQueue render_queue;
+  std::vector<Instance> sorted_instances;
+  FrameRing instance_ring;
+  FrameRing command_ring;
+  std::size_t bound_program;
+  std::size_t bound_texture;
+  std::size_t bound_normal;
+  std::size_t empty_normal_index;
+  glm::vec3 camera_pos;
+  glm::mat4 view_mat;
+  float tan_half_fovy;
+  // Level of detail each mesh was drawn with last frame, and this frame
+  std::unordered_map<ecs::entities::EntityId, std::size_t> lod_levels,
+      next_lod_levels;
+  Frustum frustum;
+  // World bounds of the meshes in each chunk of map rows, rebuilt whenever
+  // the row index changes
+  std::map<int, BoundingBox3D> chunk_bounds;
+  std::size_t chunk_version = -1;
+  std::size_t static_version = -1;
+  // Merged static chunks that passed culling this frame
+  std::vector<const StaticChunk *> visible_static;
+  // Lights of the meshes drawn this frame, binned before submission
+  std::vector<PointLight> point_lights;
+  LightClusters light_clusters;
+
   bool should_apply(ecs::Context<Registry> &ctx,
                     ecs::entities::EntityId id) override;
 
@@ -18,52 +102,39 @@ private:
 
   void post_update(ecs::Context<Registry> &ctx) override;
 
+  void update_all(ecs::Context<Registry> &ctx) override;
+
   void update_single(ecs::Context<Registry> &ctx,
                      ecs::entities::EntityId id) override;
 
-  void render_single(ecs::Context<Registry> &ctx, const components::Mesh &mesh);
-
-  void set_uniform_float(ecs::Context<Registry> &ctx, const char *name,
-                         float value);
+  void rebuild_chunks(ecs::Context<Registry> &ctx);
 
-  void set_uniform_int(ecs::Context<Registry> &ctx, const char *name,
-                       int value);
+  void extend_bounds(ecs::Context<Registry> &ctx, ecs::entities::EntityId id,
+                     const glm::mat4 &mat, BoundingBox3D &bounds);
 
-  void set_uniform_vec3(ecs::Context<Registry> &ctx, const char *name,
-                        const glm::vec3 &value);
+  void enqueue(ecs::Context<Registry> &ctx, ecs::entities::EntityId id,
+               const components::Mesh &mesh, const glm::mat4 &mat);
 
-  void set_uniform_mat4(ecs::Context<Registry> &ctx, const char *name,
-                        const glm::mat4 &value);
+  void add_headlights(ecs::Context<Registry> &ctx, ecs::entities::EntityId id,
+                      const glm::mat4 &mat);
 
-  void set_light_pos(ecs::Context<Registry> &ctx, const glm::vec3 &pos);
+  void submit(ecs::Context<Registry> &ctx);
 
-  void set_directional_light(ecs::Context<Registry> &ctx,
-                             const glm::vec3 &direction);
+  void submit_static(ecs::Context<Registry> &ctx);
 
-  void set_ambient_intensity(ecs::Context<Registry> &ctx, float intensity);
+  void submit_direct(ecs::Context<Registry> &ctx);
 
-  void set_diffuse_intensity_point(ecs::Context<Registry> &ctx,
-                                   float intensity);
+  void submit_indirect(ecs::Context<Registry> &ctx);
 
-  void set_specular_intensity_point(ecs::Context<Registry> &ctx,
-                                    float intensity);
+  std::size_t run_end(std::size_t first) const;
 
-  void set_diffuse_intensity_directional(ecs::Context<Registry> &ctx,
-                                         float intensity);
+  // Shader features a draw needs, given the world bounds it covers
+  unsigned int features(ecs::Context<Registry> &ctx, std::size_t normal_index,
+                        const BoundingBox3D &bounds) const;
 
-  void set_specular_intensity_directional(ecs::Context<Registry> &ctx,
-                                          float intensity);
+  void bind_state(ecs::Context<Registry> &ctx, std::uint64_t key);
 
-  void set_projection_mat(ecs::Context<Registry> &ctx, const glm::mat4 &mat);
-
-  void set_modelview_mat(ecs::Context<Registry> &ctx, const glm::mat4 &mat);
-
-  void set_uniform_boolean(ecs::Context<Registry> &ctx, const char *name,
-                           bool value);
-
-  void set_diffuse_on(ecs::Context<Registry> &ctx, bool flag);
-
-  void set_normal_mapping_on(ecs::Context<Registry> &ctx, bool flag);
+  void resolve_uniforms(ecs::Context<Registry> &ctx);
 
   void render_children(ecs::Context<Registry> &ctx, ecs::entities::EntityId id,
                        const glm::mat4 &base_mat);
@@ -80,27 +151,28 @@ private:
 
 class Character : public ecs::systems::System<Registry> {
 private:
-  bool should_apply(ecs::Context<Registry> &ctx,
-                    ecs::entities::EntityId id) override;
+  void update_all(ecs::Context<Registry> &ctx) override;
 
-  void pre_update(ecs::Context<Registry> &ctx) override;
+  void check_traffic(ecs::Context<Registry> &ctx);
 
-  void post_update(ecs::Context<Registry> &ctx) override;
+  void update_cell(ecs::Context<Registry> &ctx);
 
-  void update_single(ecs::Context<Registry> &ctx,
-                     ecs::entities::EntityId id) override;
+  void enter_cell(ecs::Context<Registry> &ctx, int row, int col);
+
+  void exit_cell(ecs::Context<Registry> &ctx);
+
+  void post_update(ecs::Context<Registry> &ctx) override;
 };
 
 class Car : public ecs::systems::System<Registry> {
-private:
-  bool should_apply(ecs::Context<Registry> &ctx,
-                    ecs::entities::EntityId id) override;
+public:
+  void operator()(ecs::Context<Registry> &ctx) override;
 
-  void update_single(ecs::Context<Registry> &ctx,
-                     ecs::entities::EntityId id) override;
+  static glm::mat4 transform(ecs::Context<Registry> &ctx,
+                             ecs::entities::EntityId id);
 };
 
-class Animation : public ecs::systems::System<Registry> {
+class Animation : public RegionSystem {
 private:
   glm::mat4 interpolate_transforms(float ratio, const glm::mat4 &first,
                                    const glm::mat4 &second);
@@ -118,5 +190,8 @@ public:
   static void reset(ecs::Context<Registry> &ctx, ecs::entities::EntityId id);
 
   static void disable(ecs::Context<Registry> &ctx, ecs::entities::EntityId id);
+
+  static void fast_forward(ecs::Context<Registry> &ctx,
+                           ecs::entities::EntityId id, float duration);
 };
 } // namespace systems
@@ -11,14 +11,15 @@
 #endif
 
 #include <cstdint>
+#include <vector>
 
-struct Texture {
-  GLuint texture_id;
-
-  Texture() = default;
-  Texture(const Texture &) = default;
-  Texture(Texture &&) = default;
-  Texture &operator=(const Texture &) = default;
-  Texture &operator=(Texture &&) = default;
-  Texture(std::uint8_t *texture_data, int width, int height, int channel_count);
+// Full mip chain in its upload format
+struct TextureImage {
+  GLenum internal_format = 0;
+  // Pixel format of uncompressed levels
+  GLenum format = 0;
+  bool compressed = false;
+  int width = 0;
+  int height = 0;
+  std::vector<std::vector<std::uint8_t>> levels;
 };
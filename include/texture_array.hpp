@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+
+#include "texture.hpp"
+#include "uniform_buffer.hpp"
+
+const GLuint TEXTURE_SLOT_UNIFORM_BINDING = 2;
+// Size of the "TextureSlots" array declared by every shader
+const std::size_t MAX_TEXTURE_SLOTS = 64;
+
+// Mirrors one element of the std140 "TextureSlots" array: where a texture
+// sits inside its array
+struct TextureSlot {
+  // Offset in xy and scale in zw, the whole layer unless atlased
+  glm::vec4 uv_rect;
+  float layer;
+  // Deepest mip level holding this texture alone
+  float max_level;
+  // Finest level uploaded so far; sampling is clamped to it while the rest
+  // streams in
+  float min_level;
+  float padding;
+};
+
+static_assert(sizeof(TextureSlot) == 32, "std140 layout");
+
+// Where level 0 of a texture sits inside its array
+struct TexturePlacement {
+  GLint layer = 0;
+  int x = 0;
+  int y = 0;
+  // Levels that can be written without touching other atlas entries
+  GLint level_count = 0;
+};
+
+struct TextureArray {
+  GLuint texture_id = 0;
+  GLenum internal_format = 0;
+  int width = 0;
+  int height = 0;
+  GLsizei level_count = 0;
+  GLsizei layer_count = 0;
+};
+
+// Every texture packed into one GL_TEXTURE_2D_ARRAY per format, so that
+// switching textures is a change of per-instance slot rather than a bind.
+// Textures of the array's size get a layer each; smaller ones share atlas
+// layers and have their UVs remapped by the shaders.
+struct TextureArrays {
+  std::vector<TextureArray> arrays;
+  // Per texture, in the order given to build()
+  std::vector<std::size_t> array_indices;
+  std::vector<TextureSlot> slots;
+  std::vector<TexturePlacement> placements;
+  UniformBuffer slot_uniforms;
+
+  TextureArrays() = default;
+  TextureArrays(const TextureArrays &) = default;
+  TextureArrays(TextureArrays &&) = default;
+  TextureArrays &operator=(const TextureArrays &) = default;
+  TextureArrays &operator=(TextureArrays &&) = default;
+
+  // Allocates storage and uploads whatever levels the images hold. Images
+  // without any level get a neutral placeholder in their coarsest one.
+  void build(const std::vector<TextureImage> &images);
+  // Writes rows [y, y + height) of a level of one texture. data is an
+  // offset when a GL_PIXEL_UNPACK_BUFFER is bound.
+  void upload(std::size_t texture, const TextureImage &image, GLint level,
+              int y, int height, const void *data) const;
+  // Sends the slot table after min_level changes
+  void update_slots();
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "texture.hpp"
+
+// Relative to the working directory, next to the source images
+const std::string TEXTURE_CACHE_DIRECTORY = "texture_cache";
+
+enum class TextureKind { COLOR, NORMAL };
+
+// Converts source images into block compressed mip chains on first use and
+// keeps them on disk, so later runs skip decoding, filtering and encoding.
+// Colour maps become BC1, or BC3 when they carry alpha; normal maps keep
+// x and y in BC5. Without S3TC, colour maps are cached as uncompressed RGBA.
+// load() touches no GL state and may run on any thread.
+struct TextureCache {
+  std::string directory;
+  bool s3tc_supported = false;
+
+  TextureCache() = default;
+  TextureCache(const TextureCache &) = default;
+  TextureCache(TextureCache &&) = default;
+  TextureCache &operator=(const TextureCache &) = default;
+  TextureCache &operator=(TextureCache &&) = default;
+  TextureCache(const std::string &directory);
+
+  TextureImage load(const std::string &filename, TextureKind kind) const;
+  // Size and upload format of what load() will return, read from the image
+  // header; every level is left empty
+  TextureImage describe(const std::string &filename, TextureKind kind) const;
+
+private:
+  std::string path(std::uint64_t key) const;
+  bool read(const std::string &path, TextureImage &image) const;
+  void write(const std::string &path, const TextureImage &image) const;
+  TextureImage build(const std::vector<std::uint8_t> &source,
+                     const std::string &filename, TextureKind kind) const;
+};
+
+// Half-size RGBA8 level by a 2x2 box filter
+std::vector<std::uint8_t> downsample(const std::vector<std::uint8_t> &pixels,
+                                     int width, int height);
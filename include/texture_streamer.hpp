@@ -0,0 +1,100 @@
+#pragma once
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "asset_loader.hpp"
+#include "frame_ring.hpp"
+#include "texture.hpp"
+#include "texture_array.hpp"
+#include "texture_cache.hpp"
+
+// Bytes of texel data sent to the GPU per frame at most
+const std::size_t TEXTURE_UPLOAD_BUDGET = 2 << 20;
+
+struct TextureRequest {
+  std::string filename;
+  TextureKind kind;
+};
+
+// Loads textures on the asset loader's threads and uploads them a few block
+// rows at a time, coarsest level first, so that streaming never stalls a
+// frame.
+// Uploads are staged in a ring of persistently mapped pixel buffers when
+// GL_ARB_buffer_storage is available, and sent from client memory otherwise.
+struct TextureStreamer {
+  // A decoded texture waiting for its levels to be sent
+  struct Upload {
+    std::size_t texture;
+    std::string filename;
+    TextureImage image;
+    // Next level to send and the first of its rows still missing
+    GLint level;
+    int y;
+  };
+  // State the loads use, shared with them so that it outlives the streamer
+  struct Shared {
+    TextureCache cache;
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    // Signalled as each load finishes or fails
+    std::condition_variable ready;
+    // Guarded by mutex
+    std::deque<Upload> decoded;
+    std::exception_ptr error;
+  };
+
+  std::shared_ptr<Shared> shared;
+  std::vector<TextureRequest> requests;
+  std::deque<Upload> uploads;
+  LoadProgress progress;
+  std::size_t finished_count = 0;
+  std::size_t total_count = 0;
+  FrameRing staging;
+  bool staging_supported = false;
+
+  TextureStreamer() = default;
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer(TextureStreamer &&) = default;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(TextureStreamer &&) = default;
+  // Texture i of the arrays is loaded from requests[i] once requested
+  TextureStreamer(const TextureCache &cache,
+                  const std::vector<TextureRequest> &requests,
+                  const LoadProgress &progress);
+  ~TextureStreamer();
+
+  // Queues the load of one texture on the loader's threads
+  void request(std::size_t texture, AssetLoader &loader);
+  // Sends up to TEXTURE_UPLOAD_BUDGET bytes of finished textures; called
+  // once per frame on the GL thread
+  void update(TextureArrays &texture_arrays);
+  // Waits for every requested texture and sends all of it at once, for runs
+  // that must not render before the textures are complete
+  void finish(TextureArrays &texture_arrays);
+
+  // Moves finished loads onto the upload queue, rethrowing a failed load
+  void take_decoded(const TextureArrays &texture_arrays);
+  // Sends queued rows until capacity bytes are used, copying them through
+  // staged when it is not null
+  void send(TextureArrays &texture_arrays, std::uint8_t *staged,
+            std::size_t capacity);
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ecs/entities.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct TriggerGrid {
+  std::unordered_map<std::int64_t, std::vector<ecs::entities::EntityId>>
+      cells;
+  std::unordered_map<ecs::entities::EntityId, std::vector<std::int64_t>>
+      registrations;
+
+  TriggerGrid() = default;
+  TriggerGrid(const TriggerGrid &) = default;
+  TriggerGrid(TriggerGrid &&) = default;
+  TriggerGrid &operator=(const TriggerGrid &) = default;
+  TriggerGrid &operator=(TriggerGrid &&) = default;
+
+  static std::int64_t cell_key(int row, int col);
+
+  void insert(ecs::entities::EntityId id, int row1, int col1, int row2,
+              int col2);
+  void remove(ecs::entities::EntityId id);
+  std::vector<ecs::entities::EntityId> at(int row, int col) const;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+
+struct UniformBuffer {
+  GLuint buffer_id;
+  GLuint binding;
+  std::size_t size;
+
+  UniformBuffer() = default;
+  UniformBuffer(const UniformBuffer &) = default;
+  UniformBuffer(UniformBuffer &&) = default;
+  UniformBuffer &operator=(const UniformBuffer &) = default;
+  UniformBuffer &operator=(UniformBuffer &&) = default;
+  UniformBuffer(GLuint binding, std::size_t size);
+
+  void update(const void *data);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const GLuint MATERIAL_UNIFORM_BINDING = 1;
+// Size of the "Materials" array declared by every shader
+const std::size_t MAX_MATERIALS = 256;
+// Models whose coordinates all stay within this distance of the origin store
+// positions as half floats, a step of at most 1/256 at the edge
+const float HALF_POSITION_EXTENT = 4.0f;
+
+// Mirrors one element of the std140 "Materials" array
+struct Material {
+  glm::vec4 ambient;
+  glm::vec4 diffuse;
+  // Shininess in w
+  glm::vec4 specular;
+};
+
+static_assert(sizeof(Material) == 48, "std140 layout");
+
+// Unpacked vertex, kept on the CPU for simplification and static batching
+struct MeshVertex {
+  glm::vec3 pos;
+  glm::vec3 normal;
+  // Sign of the bitangent against cross(normal, tangent) in w
+  glm::vec4 tangent;
+  glm::vec2 uv;
+  // Index into the material table
+  GLuint material = 0;
+};
+
+enum class PositionFormat { HALF, FLOAT };
+
+PositionFormat position_format(const std::vector<MeshVertex> &vertices);
+
+// Bytes per packed vertex: position, normal and tangent as
+// GL_INT_2_10_10_10_REV, half float UV and a 16-bit material index
+std::size_t vertex_size(PositionFormat format);
+
+std::vector<std::uint8_t> pack_vertices(const std::vector<MeshVertex> &vertices,
+                                        PositionFormat format);
+
+// Attributes 0 to 4 for packed vertices, applied to the bound VAO and array
+// buffer
+void bind_vertex_layout(PositionFormat format);
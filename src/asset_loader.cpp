@@ -0,0 +1,51 @@
+#include "asset_loader.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+AssetLoader::AssetLoader(std::size_t thread_count,
+                         const LoadProgress &progress)
+    : shared(std::make_shared<Shared>()), progress(progress) {
+  auto state = shared;
+  for (std::size_t i = 0; i < thread_count; i++)
+    threads.emplace_back([state]() {
+      while (true) {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(state->mutex);
+          state->ready.wait(
+              lock, [&]() { return state->stop || !state->tasks.empty(); });
+          if (state->stop)
+            return;
+          task = std::move(state->tasks.front());
+          state->tasks.pop_front();
+        }
+        task();
+      }
+    });
+}
+
+AssetLoader::~AssetLoader() {
+  if (shared) {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    shared->stop = true;
+    shared->ready.notify_all();
+  }
+  for (auto &thread : threads)
+    thread.join();
+}
+
+void AssetLoader::submit(std::function<void()> task) {
+  std::lock_guard<std::mutex> lock(shared->mutex);
+  shared->tasks.push_back(std::move(task));
+  shared->ready.notify_one();
+}
+
+std::size_t AssetLoader::default_thread_count() {
+  const auto hardware = std::thread::hardware_concurrency();
+  return hardware > 1 ? hardware - 1 : 1;
+}
@@ -105,6 +105,11 @@ glm::vec3 BoundingBox3D::midpoint() const {
   return 0.5f * (min_point + max_point);
 }
 
+BoundingBox3D BoundingBox3D::merge(const BoundingBox3D &other) const {
+  return {glm::min(min_point, other.min_point),
+          glm::max(max_point, other.max_point)};
+}
+
 BoundingBox3D BoundingBox3D::transform(const glm::mat4 &transform) const {
   const auto min_point_4d =
                  glm::vec4(min_point[0], min_point[1], min_point[2], 1),
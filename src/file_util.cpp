@@ -0,0 +1,55 @@
+#include "file_util.hpp"
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+std::uint64_t fnv1a(std::uint64_t seed, const void *data, std::size_t size) {
+  auto value = seed;
+  const auto *bytes = static_cast<const std::uint8_t *>(data);
+  for (std::size_t i = 0; i < size; i++)
+    value = (value ^ bytes[i]) * FNV_PRIME;
+  return value;
+}
+
+std::uint64_t hash(std::uint64_t seed, const std::string &data) {
+  std::uint8_t size[sizeof(std::uint64_t)];
+  for (std::size_t i = 0; i < sizeof(size); i++)
+    size[i] = static_cast<std::uint8_t>(data.size() >> (8 * i));
+  return fnv1a(fnv1a(seed, data.data(), data.size()), size, sizeof(size));
+}
+
+std::uint64_t file_stamp(std::uint64_t seed, const std::string &filename) {
+  std::int64_t values[2] = {-1, -1};
+  struct stat status;
+  if (stat(filename.c_str(), &status) == 0) {
+    values[0] = status.st_size;
+    values[1] = status.st_mtime;
+  }
+  return fnv1a(seed, values, sizeof(values));
+}
+
+bool read_file(const std::string &filename, std::string &contents) {
+  std::ifstream infile(filename, std::ios::binary);
+  if (!infile)
+    return false;
+  contents.assign(std::istreambuf_iterator<char>(infile),
+                  std::istreambuf_iterator<char>());
+  return true;
+}
+
+void make_directory(const std::string &path) {
+#ifdef _WIN32
+  _mkdir(path.c_str());
+#else
+  mkdir(path.c_str(), 0755);
+#endif
+}
@@ -0,0 +1,77 @@
+#include "frame_ring.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+FrameRing::FrameRing(GLenum target, std::size_t slot_size)
+    : target(target), slot_size(slot_size) {
+  create();
+}
+
+bool FrameRing::reserve(std::size_t size) {
+  if (size <= slot_size)
+    return false;
+
+  for (std::size_t i = 0; i < FRAME_COUNT; i++)
+    wait(i);
+  glBindBuffer(target, buffer_id);
+  glUnmapBuffer(target);
+  glBindBuffer(target, 0);
+  glDeleteBuffers(1, &buffer_id);
+  while (slot_size < size)
+    slot_size *= 2;
+  create();
+  return true;
+}
+
+void *FrameRing::begin_frame() {
+  wait(slot);
+  return mapped + offset();
+}
+
+void FrameRing::end_frame() {
+  fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot = (slot + 1) % FRAME_COUNT;
+}
+
+std::size_t FrameRing::offset() const { return slot * slot_size; }
+
+void FrameRing::create() {
+#ifdef __APPLE__
+  throw std::runtime_error("persistently mapped buffers are not supported");
+#else
+  const GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &buffer_id);
+  glBindBuffer(target, buffer_id);
+  glBufferStorage(target, slot_size * FRAME_COUNT, nullptr, flags);
+  mapped = static_cast<std::uint8_t *>(
+      glMapBufferRange(target, 0, slot_size * FRAME_COUNT, flags));
+  glBindBuffer(target, 0);
+  if (mapped == nullptr)
+    throw std::runtime_error("buffer mapping failed");
+  slot = 0;
+#endif
+}
+
+void FrameRing::wait(std::size_t slot) {
+  auto &fence = fences[slot];
+  if (fence == nullptr)
+    return;
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) ==
+         GL_TIMEOUT_EXPIRED)
+    ;
+  glDeleteSync(fence);
+  fence = nullptr;
+}
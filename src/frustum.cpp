@@ -0,0 +1,95 @@
+#include "frustum.hpp"
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FRUSTUM_NEON
+#endif
+
+#include <cmath>
+#include <cstddef>
+
+#include "bounding_box.hpp"
+
+Frustum::Frustum(const glm::mat4 &view_projection) {
+  // Gribb-Hartmann: each plane is the last row plus or minus another row
+  const auto row = [&](int i) {
+    return glm::vec4(view_projection[0][i], view_projection[1][i],
+                     view_projection[2][i], view_projection[3][i]);
+  };
+  planes = {row(3) + row(0), row(3) - row(0), row(3) + row(1),
+            row(3) - row(1), row(3) + row(2), row(3) - row(2)};
+  for (std::size_t i = 0; i < 8; i++) {
+    const auto plane = i < planes.size() ? planes[i] : glm::vec4(0, 0, 0, 1);
+    plane_x[i] = plane[0];
+    plane_y[i] = plane[1];
+    plane_z[i] = plane[2];
+    plane_w[i] = plane[3];
+  }
+}
+
+bool Frustum::intersect_with(const BoundingBox3D &box) const {
+  // A box is outside once its nearest corner is behind any plane, that is
+  // n . center + |n| . extent + w < 0
+  const auto center = box.midpoint();
+  const auto extent = 0.5f * (box.max_point - box.min_point);
+#if defined(FRUSTUM_SSE)
+  const auto sign_mask = _mm_set1_ps(-0.0f);
+  const auto cx = _mm_set1_ps(center[0]), cy = _mm_set1_ps(center[1]),
+             cz = _mm_set1_ps(center[2]);
+  const auto ex = _mm_set1_ps(extent[0]), ey = _mm_set1_ps(extent[1]),
+             ez = _mm_set1_ps(extent[2]);
+  for (std::size_t i = 0; i < 8; i += 4) {
+    const auto nx = _mm_load_ps(plane_x + i), ny = _mm_load_ps(plane_y + i),
+               nz = _mm_load_ps(plane_z + i), w = _mm_load_ps(plane_w + i);
+    const auto distance = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+        _mm_add_ps(_mm_mul_ps(nz, cz), w));
+    const auto radius =
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, nx), ex),
+                              _mm_mul_ps(_mm_andnot_ps(sign_mask, ny), ey)),
+                   _mm_mul_ps(_mm_andnot_ps(sign_mask, nz), ez));
+    if (_mm_movemask_ps(
+            _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())))
+      return false;
+  }
+  return true;
+#elif defined(FRUSTUM_NEON)
+  for (std::size_t i = 0; i < 8; i += 4) {
+    const auto nx = vld1q_f32(plane_x + i), ny = vld1q_f32(plane_y + i),
+               nz = vld1q_f32(plane_z + i), w = vld1q_f32(plane_w + i);
+    auto distance = vmlaq_n_f32(w, nx, center[0]);
+    distance = vmlaq_n_f32(distance, ny, center[1]);
+    distance = vmlaq_n_f32(distance, nz, center[2]);
+    distance = vmlaq_n_f32(distance, vabsq_f32(nx), extent[0]);
+    distance = vmlaq_n_f32(distance, vabsq_f32(ny), extent[1]);
+    distance = vmlaq_n_f32(distance, vabsq_f32(nz), extent[2]);
+    if (vmaxvq_u32(vcltq_f32(distance, vdupq_n_f32(0))))
+      return false;
+  }
+  return true;
+#else
+  for (const auto &plane : planes) {
+    const auto normal = glm::vec3(plane);
+    if (glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) +
+            plane[3] <
+        0)
+      return false;
+  }
+  return true;
+#endif
+}
+
+BoundingBox3D transform_bounds(const BoundingBox3D &box,
+                               const glm::mat4 &mat) {
+  const auto center = glm::vec3(mat * glm::vec4(box.midpoint(), 1));
+  const auto extent = 0.5f * (box.max_point - box.min_point);
+  glm::vec3 world_extent(0);
+  for (int i = 0; i < 3; i++)
+    world_extent += glm::abs(glm::vec3(mat[i])) * extent[i];
+  return {center - world_extent, center + world_extent};
+}
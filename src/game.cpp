@@ -1,6 +1,9 @@
 #include "ecs/systems.hpp"
 
+#include <cstddef>
+#include <iostream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -17,18 +20,32 @@
 #include <GL/glut.h>
 #endif
 
+#include "asset_loader.hpp"
+#include "platform/platform.hpp"
 #include "registry.hpp"
 #include "scene.hpp"
 #include "systems.hpp"
 
 // TODO: use singleton
 std::shared_ptr<ecs::Context<Registry>> ctx_ptr;
+std::unique_ptr<platform::Platform> platform_ptr;
+platform::BenchmarkOptions options;
+std::size_t frame_count = 0;
+
+bool display() {
+  ctx_ptr->update();
+  frame_count++;
+  const auto last_frame = options.frames > 0 && frame_count >= options.frames;
+  if (last_frame && !options.dump_path.empty())
+    platform_ptr->write_png(options.dump_path);
+  platform_ptr->swap_buffers();
+  ctx_ptr->registry().profiler.end_frame();
+  if (last_frame)
+    std::cout << ctx_ptr->registry().profiler.report() << std::flush;
+  return !last_frame;
+}
 
-void display() { ctx_ptr->update(); }
-
-void idle() { glutPostRedisplay(); }
-
-void keyboard_handle(int key, int x, int y) {
+void keyboard_handle(int key) {
   switch (key) {
   case GLUT_KEY_UP:
     ctx_ptr->registry().input_queue.push(InputKind::UP);
@@ -45,7 +62,7 @@ void keyboard_handle(int key, int x, int y) {
   }
 }
 
-void keyboard_handle_non_special(unsigned char key, int x, int y) {
+void keyboard_handle_non_special(unsigned char key) {
   if (key == 'p')
     ctx_ptr->registry().pass_through = !ctx_ptr->registry().pass_through;
 
@@ -53,40 +70,63 @@ void keyboard_handle_non_special(unsigned char key, int x, int y) {
     ctx_ptr->registry().view_mode = (ctx_ptr->registry().view_mode + 1) %
                                     ctx_ptr->registry().camera_config.size();
   if (key == 'x')
-    ctx_ptr->registry().program_index =
-        (ctx_ptr->registry().program_index + 1) %
-        ctx_ptr->registry().shader_programs.size();
+    ctx_ptr->registry().shader_index =
+        (ctx_ptr->registry().shader_index + 1) %
+        ctx_ptr->registry().shader_variants.size();
 
   if (key == 't')
     ctx_ptr->registry().diffuse_on = !ctx_ptr->registry().diffuse_on;
 
   if (key == 'n')
     ctx_ptr->registry().normal_mapping_on = !ctx_ptr->registry().normal_mapping_on;
+
+  if (key == 'f')
+    std::cout << ctx_ptr->registry().profiler.report() << std::flush;
+
+  if (key == 'm')
+    ctx_ptr->registry().indirect_draw = !ctx_ptr->registry().indirect_draw &&
+                                        ctx_ptr->registry().indirect_supported;
 }
 
 int main(int argc, char **argv) {
-  glutInit(&argc, argv);
-#ifdef __APPLE__
-  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH |
-                      GLUT_3_2_CORE_PROFILE);
-#else
-  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-#endif
-  glutInitWindowSize(512, 512);
-  glutCreateWindow("Crossy Ponix");
-
-#ifndef __APPLE__
-  glewInit();
-#endif
+  options = platform::BenchmarkOptions::parse(argc, argv);
+  platform_ptr = platform::create(argc, argv, options.config("Crossy Ponix"));
 
   std::vector<std::shared_ptr<ecs::systems::System<Registry>>> systems;
-  systems.emplace_back(new systems::Animation);
-  systems.emplace_back(new systems::Render);
-  systems.emplace_back(new systems::InputHandler);
-  systems.emplace_back(new systems::Character);
-  systems.emplace_back(new systems::Car);
-  ctx_ptr =
-      std::make_shared<ecs::Context<Registry>>(Registry(), std::move(systems));
+  systems.emplace_back(new systems::Timed("activity", new systems::Activity));
+  systems.emplace_back(
+      new systems::Timed("animation", new systems::Animation));
+  systems.emplace_back(new systems::Timed("render", new systems::Render));
+  systems.emplace_back(
+      new systems::Timed("input", new systems::InputHandler));
+  systems.emplace_back(
+      new systems::Timed("character", new systems::Character));
+  systems.emplace_back(new systems::Timed("car", new systems::Car));
+  // Assets report as they finish; outside benchmark runs, textures keep
+  // arriving after the first frame
+  const LoadProgress progress = [](const std::string &filename,
+                                   std::size_t finished, std::size_t total) {
+    std::cout << "Loaded " << filename << " (" << finished << "/" << total
+              << ")\n";
+  };
+  ctx_ptr = std::make_shared<ecs::Context<Registry>>(Registry(progress),
+                                                     std::move(systems));
+  ctx_ptr->registry().viewport_width = platform_ptr->width();
+  ctx_ptr->registry().viewport_height = platform_ptr->height();
+  if (options.seeded)
+    ctx_ptr->seed(options.seed);
+  // Benchmark runs step a fixed 60 Hz so every run simulates the same frames,
+  // and wait for every texture so that none of them renders half streamed
+  if (options.frames > 0) {
+    ctx_ptr->set_fixed_delta_time(1.0f / 60);
+    ctx_ptr->registry().texture_streamer.finish(
+        ctx_ptr->registry().texture_arrays);
+  }
+
+  // Arguments left over after the platform took its own
+  for (int i = 1; i < argc; i++)
+    if (std::string(argv[i]) == "--profile-csv" && i + 1 < argc)
+      ctx_ptr->registry().profiler.open_csv(argv[++i]);
 
   glClearColor(0, 0, 0, 1);
   glDepthFunc(GL_LEQUAL);
@@ -98,9 +138,9 @@ int main(int argc, char **argv) {
   while (ctx_ptr->registry().map_top_generated <= 24)
     create_map(*ctx_ptr);
 
-  glutDisplayFunc(display);
-  glutIdleFunc(idle);
-  glutKeyboardFunc(keyboard_handle_non_special);
-  glutSpecialFunc(keyboard_handle);
-  glutMainLoop();
+  platform_ptr->on_key(keyboard_handle_non_special);
+  platform_ptr->on_special_key(keyboard_handle);
+  platform_ptr->run(display);
+  // GL objects go before the context that owns them
+  ctx_ptr.reset();
 }
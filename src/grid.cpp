@@ -15,3 +15,8 @@ BoundingBox3D grid_to_world(int row1, int col1, int row2, int col2) {
     std::swap(top_left[2], bottom_right[2]);
   return BoundingBox3D(top_left, bottom_right);
 }
+
+int row_chunk(int row) {
+  return row >= 0 ? row / MAP_CHUNK_ROWS
+                  : -((MAP_CHUNK_ROWS - 1 - row) / MAP_CHUNK_ROWS);
+}
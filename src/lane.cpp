@@ -0,0 +1,81 @@
+#include "lane.hpp"
+
+#include "ecs/entities.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace {
+float wrap(float x) {
+  const auto r = std::fmod(x, LANE_LENGTH);
+  return r < 0.0f ? r + LANE_LENGTH : r;
+}
+
+bool phase_less(const LaneSlot &slot, float phase) {
+  return slot.phase < phase;
+}
+} // namespace
+
+Lane::Lane() : Lane(0.0f) {}
+
+Lane::Lane(float speed)
+    : speed(speed), slots(), min_extent(0.0f), max_extent(0.0f) {}
+
+float Lane::add(ecs::entities::EntityId id, float pos_x, float min_x,
+                float max_x) {
+  const auto phase = wrap(pos_x - LANE_MIN_X);
+  const auto it =
+      std::lower_bound(slots.begin(), slots.end(), phase, phase_less);
+  slots.insert(it, {id, phase, min_x, max_x});
+  min_extent = std::min(min_extent, min_x);
+  max_extent = std::max(max_extent, max_x);
+  return phase;
+}
+
+float Lane::position(float phase, double time) const {
+  return LANE_MIN_X + wrap(phase + travelled(time));
+}
+
+std::vector<ecs::entities::EntityId> Lane::query(float xmin, float xmax,
+                                                 double time) const {
+  std::vector<ecs::entities::EntityId> result;
+  const auto check = [&](std::vector<LaneSlot>::const_iterator first,
+                         std::vector<LaneSlot>::const_iterator last) {
+    for (auto it = first; it != last; it++) {
+      const auto x = position(it->phase, time);
+      if (x + it->min_x <= xmax && xmin <= x + it->max_x)
+        result.push_back(it->id);
+    }
+  };
+
+  // Any car that can overlap [xmin, xmax] has its position inside this range.
+  const auto lo = xmin - max_extent, hi = xmax - min_extent;
+  if (hi - lo >= LANE_LENGTH) {
+    check(slots.cbegin(), slots.cend());
+    return result;
+  }
+
+  // Map the position range back to phases at time zero.
+  const auto phase_lo = wrap(lo - LANE_MIN_X - travelled(time)),
+             phase_hi = phase_lo + (hi - lo);
+  const auto first = std::lower_bound(slots.cbegin(), slots.cend(), phase_lo,
+                                      phase_less);
+  if (phase_hi < LANE_LENGTH) {
+    check(first, std::lower_bound(first, slots.cend(),
+                                  std::nextafter(phase_hi, LANE_LENGTH),
+                                  phase_less));
+  } else {
+    check(first, slots.cend());
+    check(slots.cbegin(),
+          std::lower_bound(slots.cbegin(), first,
+                           std::nextafter(phase_hi - LANE_LENGTH, LANE_LENGTH),
+                           phase_less));
+  }
+  return result;
+}
+
+float Lane::travelled(double time) const {
+  return static_cast<float>(std::fmod(speed * time, double(LANE_LENGTH)));
+}
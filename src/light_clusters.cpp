@@ -0,0 +1,191 @@
+#include "light_clusters.hpp"
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "bounding_box.hpp"
+#include "components.hpp"
+
+namespace {
+bool sphere_intersects(const glm::vec3 &center, float radius,
+                       const BoundingBox3D &box) {
+  const auto closest = glm::clamp(center, box.min_point, box.max_point);
+  const auto offset = closest - center;
+  return glm::dot(offset, offset) <= radius * radius;
+}
+
+int tile(float ndc, int count) {
+  return std::min(std::max(int((ndc + 1) / 2 * count), 0), count - 1);
+}
+
+void create_buffer_texture(GLuint &buffer_id, GLuint &texture_id,
+                           GLenum format) {
+  glGenBuffers(1, &buffer_id);
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer_id);
+  glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+  glGenTextures(1, &texture_id);
+  glBindTexture(GL_TEXTURE_BUFFER, texture_id);
+  glTexBuffer(GL_TEXTURE_BUFFER, format, buffer_id);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void update_buffer(GLuint buffer_id, const void *data, std::size_t size) {
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer_id);
+  // Orphaning keeps the driver from waiting on last frame's reads; an empty
+  // store is not a valid texture buffer
+  glBufferData(GL_TEXTURE_BUFFER, std::max<std::size_t>(size, 16), nullptr,
+               GL_STREAM_DRAW);
+  if (size > 0)
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
+} // namespace
+
+bool PointLight::reaches(const BoundingBox3D &bounds) const {
+  return sphere_intersects(pos, radius, bounds);
+}
+
+void LightClusters::build(const std::vector<PointLight> &lights,
+                          const glm::mat4 &view_mat,
+                          const components::CameraConfig &camera) {
+  if (bounds.empty() || camera.fovy != fovy ||
+      camera.aspect_ratio != aspect_ratio || camera.znear != znear ||
+      camera.zfar != zfar)
+    build_bounds(camera);
+
+  const auto tan_y = std::tan(glm::radians(fovy) / 2);
+  const auto tan_x = tan_y * aspect_ratio;
+  overlaps.clear();
+  for (std::size_t i = 0; i < lights.size(); i++) {
+    const auto &light = lights[i];
+    const auto center = glm::vec3(view_mat * glm::vec4(light.pos, 1));
+    const auto near_depth = std::max(-center.z - light.radius, znear);
+    const auto far_depth = std::min(-center.z + light.radius, zfar);
+    if (near_depth >= far_depth)
+      continue;
+
+    // Screen extent of the light's view-space box, over both ends of its
+    // depth range
+    auto min_ndc = glm::vec2(1), max_ndc = glm::vec2(-1);
+    for (const auto depth : {near_depth, far_depth})
+      for (const auto side : {-light.radius, light.radius}) {
+        const auto ndc = glm::vec2((center.x + side) / (depth * tan_x),
+                                   (center.y + side) / (depth * tan_y));
+        min_ndc = glm::min(min_ndc, ndc);
+        max_ndc = glm::max(max_ndc, ndc);
+      }
+    if (max_ndc.x < -1 || max_ndc.y < -1 || min_ndc.x > 1 || min_ndc.y > 1)
+      continue;
+
+    for (int z = slice(near_depth); z <= slice(far_depth); z++)
+      for (int y = tile(min_ndc.y, CLUSTER_COUNT_Y);
+           y <= tile(max_ndc.y, CLUSTER_COUNT_Y); y++)
+        for (int x = tile(min_ndc.x, CLUSTER_COUNT_X);
+             x <= tile(max_ndc.x, CLUSTER_COUNT_X); x++) {
+          const GLuint cluster =
+              (z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x;
+          if (sphere_intersects(center, light.radius, bounds[cluster]))
+            overlaps.emplace_back(cluster, i);
+        }
+  }
+
+  // Counting sort of the overlaps by cluster
+  ranges.assign(2 * CLUSTER_COUNT, 0);
+  for (const auto &overlap : overlaps)
+    ranges[2 * overlap.first + 1]++;
+  GLuint offset = 0;
+  for (int i = 0; i < CLUSTER_COUNT; i++) {
+    ranges[2 * i] = offset;
+    offset += ranges[2 * i + 1];
+  }
+  indices.resize(overlaps.size());
+  std::vector<GLuint> filled(CLUSTER_COUNT, 0);
+  for (const auto &overlap : overlaps)
+    indices[ranges[2 * overlap.first] + filled[overlap.first]++] =
+        overlap.second;
+}
+
+void LightClusters::upload(const std::vector<PointLight> &lights) {
+  if (light_texture_id == 0) {
+    create_buffer_texture(light_buffer_id, light_texture_id, GL_RGBA32F);
+    create_buffer_texture(cluster_buffer_id, cluster_texture_id, GL_RG32UI);
+    create_buffer_texture(index_buffer_id, index_texture_id, GL_R32UI);
+  }
+  update_buffer(light_buffer_id, lights.data(),
+                sizeof(PointLight) * lights.size());
+  update_buffer(cluster_buffer_id, ranges.data(),
+                sizeof(GLuint) * ranges.size());
+  update_buffer(index_buffer_id, indices.data(),
+                sizeof(GLuint) * indices.size());
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bind() const {
+  glActiveTexture(GL_TEXTURE0 + LIGHT_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, light_texture_id);
+  glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, cluster_texture_id);
+  glActiveTexture(GL_TEXTURE0 + LIGHT_INDEX_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, index_texture_id);
+}
+
+float LightClusters::depth_scale() const {
+  return CLUSTER_COUNT_Z / std::log(zfar / znear);
+}
+
+float LightClusters::depth_bias() const {
+  return -std::log(znear) * depth_scale();
+}
+
+void LightClusters::build_bounds(const components::CameraConfig &camera) {
+  fovy = camera.fovy;
+  aspect_ratio = camera.aspect_ratio;
+  znear = camera.znear;
+  zfar = camera.zfar;
+  const auto tan_y = std::tan(glm::radians(fovy) / 2);
+  const auto tan_x = tan_y * aspect_ratio;
+
+  bounds.resize(CLUSTER_COUNT);
+  for (int z = 0; z < CLUSTER_COUNT_Z; z++) {
+    const auto near_depth =
+        znear * std::pow(zfar / znear, float(z) / CLUSTER_COUNT_Z);
+    const auto far_depth =
+        znear * std::pow(zfar / znear, float(z + 1) / CLUSTER_COUNT_Z);
+    for (int y = 0; y < CLUSTER_COUNT_Y; y++)
+      for (int x = 0; x < CLUSTER_COUNT_X; x++) {
+        const auto ndc_min = glm::vec2(-1 + 2.0f * x / CLUSTER_COUNT_X,
+                                       -1 + 2.0f * y / CLUSTER_COUNT_Y);
+        const auto ndc_max = glm::vec2(-1 + 2.0f * (x + 1) / CLUSTER_COUNT_X,
+                                       -1 + 2.0f * (y + 1) / CLUSTER_COUNT_Y);
+        const auto scale = glm::vec2(tan_x, tan_y);
+        // The frustum widens with depth, so the box spans both end caps
+        const auto min_point = glm::min(ndc_min * scale * near_depth,
+                                        ndc_min * scale * far_depth);
+        const auto max_point = glm::max(ndc_max * scale * near_depth,
+                                        ndc_max * scale * far_depth);
+        bounds[(z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x] =
+            BoundingBox3D(glm::vec3(min_point, -far_depth),
+                          glm::vec3(max_point, -near_depth));
+      }
+  }
+}
+
+int LightClusters::slice(float depth) const {
+  return std::min(std::max(int(std::log(depth) * depth_scale() + depth_bias()),
+                           0),
+                  CLUSTER_COUNT_Z - 1);
+}
@@ -0,0 +1,230 @@
+#include "mesh_bvh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "bounding_box.hpp"
+
+namespace {
+bool separated_on_axis(const glm::vec3 &axis, const glm::vec3 &v0,
+                       const glm::vec3 &v1, const glm::vec3 &v2,
+                       const glm::vec3 &half) {
+  const auto p0 = glm::dot(v0, axis), p1 = glm::dot(v1, axis),
+             p2 = glm::dot(v2, axis);
+  const auto r = half[0] * std::abs(axis[0]) + half[1] * std::abs(axis[1]) +
+                 half[2] * std::abs(axis[2]);
+  return std::min({p0, p1, p2}) > r || std::max({p0, p1, p2}) < -r;
+}
+
+// Separating axis test of Akenine-Moller: the three box normals, the
+// triangle normal and the nine edge cross products.
+bool triangle_box_overlap(const BoundingBox3D &box, glm::vec3 v0,
+                          glm::vec3 v1, glm::vec3 v2) {
+  const auto center = box.midpoint(),
+             half = 0.5f * (box.max_point - box.min_point);
+  v0 -= center;
+  v1 -= center;
+  v2 -= center;
+
+  for (int i = 0; i < 3; i++)
+    if (std::min({v0[i], v1[i], v2[i]}) > half[i] ||
+        std::max({v0[i], v1[i], v2[i]}) < -half[i])
+      return false;
+
+  const glm::vec3 edges[] = {v1 - v0, v2 - v1, v0 - v2};
+  if (separated_on_axis(glm::cross(edges[0], edges[1]), v0, v1, v2, half))
+    return false;
+
+  const glm::vec3 box_axes[] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  for (const auto &edge : edges)
+    for (const auto &box_axis : box_axes)
+      if (separated_on_axis(glm::cross(edge, box_axis), v0, v1, v2, half))
+        return false;
+  return true;
+}
+
+bool ray_box_overlap(const BoundingBox3D &box, const glm::vec3 &origin,
+                     const glm::vec3 &inv_direction, float max_distance) {
+  float t_min = 0.0f, t_max = max_distance;
+  for (int i = 0; i < 3; i++) {
+    auto t0 = (box.min_point[i] - origin[i]) * inv_direction[i],
+         t1 = (box.max_point[i] - origin[i]) * inv_direction[i];
+    if (t0 > t1)
+      std::swap(t0, t1);
+    t_min = std::max(t_min, t0);
+    t_max = std::min(t_max, t1);
+    if (t_min > t_max)
+      return false;
+  }
+  return true;
+}
+
+// Moller-Trumbore
+bool ray_triangle_intersect(const glm::vec3 &origin,
+                            const glm::vec3 &direction, const glm::vec3 &v0,
+                            const glm::vec3 &v1, const glm::vec3 &v2,
+                            float &distance) {
+  const auto edge1 = v1 - v0, edge2 = v2 - v0;
+  const auto p = glm::cross(direction, edge2);
+  const auto det = glm::dot(edge1, p);
+  if (std::abs(det) < 1e-8f)
+    return false;
+  const auto inv_det = 1.0f / det;
+  const auto s = origin - v0;
+  const auto u = glm::dot(s, p) * inv_det;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+  const auto q = glm::cross(s, edge1);
+  const auto v = glm::dot(direction, q) * inv_det;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+  const auto t = glm::dot(edge2, q) * inv_det;
+  if (t < 0.0f)
+    return false;
+  distance = t;
+  return true;
+}
+} // namespace
+
+MeshBvh::MeshBvh(const std::vector<float> &vertices,
+                 const std::vector<std::uint32_t> &indices) {
+  const std::uint32_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+    return;
+
+  triangles.resize(3 * triangle_count);
+  std::vector<glm::vec3> centroids(triangle_count);
+  for (std::uint32_t i = 0; i < triangle_count; i++) {
+    for (std::uint32_t k = 0; k < 3; k++) {
+      const auto index = indices[3 * i + k];
+      triangles[3 * i + k] = {vertices[3 * index], vertices[3 * index + 1],
+                              vertices[3 * index + 2]};
+    }
+    centroids[i] =
+        (triangles[3 * i] + triangles[3 * i + 1] + triangles[3 * i + 2]) /
+        3.0f;
+  }
+
+  std::vector<std::uint32_t> order(triangle_count);
+  std::iota(order.begin(), order.end(), 0);
+  nodes.reserve(2 * triangle_count / LEAF_SIZE + 1);
+  build(order, centroids, 0, triangle_count);
+
+  std::vector<glm::vec3> reordered(triangles.size());
+  for (std::uint32_t i = 0; i < triangle_count; i++)
+    for (std::uint32_t k = 0; k < 3; k++)
+      reordered[3 * i + k] = triangles[3 * order[i] + k];
+  triangles = std::move(reordered);
+}
+
+std::uint32_t MeshBvh::build(std::vector<std::uint32_t> &order,
+                             const std::vector<glm::vec3> &centroids,
+                             std::uint32_t first, std::uint32_t count) {
+  const std::uint32_t node_index = nodes.size();
+  nodes.push_back({});
+
+  std::vector<glm::vec3> corners;
+  corners.reserve(3 * count);
+  auto centroid_min = centroids[order[first]],
+       centroid_max = centroids[order[first]];
+  for (std::uint32_t i = first; i < first + count; i++) {
+    for (std::uint32_t k = 0; k < 3; k++)
+      corners.push_back(triangles[3 * order[i] + k]);
+    centroid_min = glm::min(centroid_min, centroids[order[i]]);
+    centroid_max = glm::max(centroid_max, centroids[order[i]]);
+  }
+  nodes[node_index].bounds = BoundingBox3D::from_vertices(corners);
+
+  if (count <= LEAF_SIZE) {
+    nodes[node_index].first = first;
+    nodes[node_index].count = count;
+    return node_index;
+  }
+
+  // Median split along the widest axis of the centroids
+  const auto extent = centroid_max - centroid_min;
+  int axis = 0;
+  if (extent[1] > extent[axis])
+    axis = 1;
+  if (extent[2] > extent[axis])
+    axis = 2;
+  const auto half = count / 2;
+  std::nth_element(order.begin() + first, order.begin() + first + half,
+                   order.begin() + first + count,
+                   [&](std::uint32_t a, std::uint32_t b) {
+                     return centroids[a][axis] < centroids[b][axis];
+                   });
+
+  build(order, centroids, first, half);
+  const auto right = build(order, centroids, first + half, count - half);
+  nodes[node_index].first = right;
+  nodes[node_index].count = 0;
+  return node_index;
+}
+
+bool MeshBvh::empty() const { return nodes.empty(); }
+
+bool MeshBvh::intersect_with(const BoundingBox3D &box) const {
+  if (nodes.empty())
+    return false;
+
+  std::vector<std::uint32_t> stack = {0};
+  while (!stack.empty()) {
+    const auto node_index = stack.back();
+    const auto &node = nodes[node_index];
+    stack.pop_back();
+    if (!node.bounds.intersect_with(box))
+      continue;
+    if (node.count == 0) {
+      stack.push_back(node.first);
+      stack.push_back(node_index + 1);
+      continue;
+    }
+    for (std::uint32_t i = node.first; i < node.first + node.count; i++)
+      if (triangle_box_overlap(box, triangles[3 * i], triangles[3 * i + 1],
+                               triangles[3 * i + 2]))
+        return true;
+  }
+  return false;
+}
+
+bool MeshBvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                      float &distance) const {
+  if (nodes.empty())
+    return false;
+
+  const glm::vec3 inv_direction = {1.0f / direction[0], 1.0f / direction[1],
+                                   1.0f / direction[2]};
+  auto closest = std::numeric_limits<float>::infinity();
+  std::vector<std::uint32_t> stack = {0};
+  while (!stack.empty()) {
+    const auto node_index = stack.back();
+    const auto &node = nodes[node_index];
+    stack.pop_back();
+    if (!ray_box_overlap(node.bounds, origin, inv_direction, closest))
+      continue;
+    if (node.count == 0) {
+      stack.push_back(node.first);
+      stack.push_back(node_index + 1);
+      continue;
+    }
+    for (std::uint32_t i = node.first; i < node.first + node.count; i++) {
+      float t;
+      if (ray_triangle_intersect(origin, direction, triangles[3 * i],
+                                 triangles[3 * i + 1], triangles[3 * i + 2],
+                                 t))
+        closest = std::min(closest, t);
+    }
+  }
+  if (std::isinf(closest))
+    return false;
+  distance = closest;
+  return true;
+}
@@ -0,0 +1,281 @@
+#include "mesh_cache.hpp"
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "bounding_box.hpp"
+#include "file_util.hpp"
+#include "mesh_bvh.hpp"
+#include "model.hpp"
+#include "vertex_format.hpp"
+
+namespace {
+const std::uint32_t MESH_CACHE_MAGIC = 0x534d5043; // "CPMS"
+// Bumped whenever load_obj()'s output or the layout below changes
+const std::uint32_t MESH_CACHE_VERSION = 2;
+
+// Followed by the material library names, one per line, the index count of
+// each LOD, then the materials, vertices, LOD indices, BVH triangles and BVH
+// nodes, each stored as raw arrays
+struct MeshFileHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t source_hash;
+  std::uint64_t source_stamp;
+  std::uint32_t material_count;
+  std::uint32_t vertex_count;
+  std::uint32_t lod_count;
+  std::uint32_t bvh_triangle_count;
+  std::uint32_t bvh_node_count;
+  float acmr_before;
+  float acmr_after;
+  std::uint32_t libraries_size;
+  BoundingBox3D bounding_box;
+};
+
+static_assert(sizeof(MeshFileHeader) == 80, "header is stored bytewise");
+static_assert(std::is_trivially_copyable<MeshVertex>::value &&
+                  std::is_trivially_copyable<Material>::value &&
+                  std::is_trivially_copyable<MeshBvhNode>::value,
+              "sections are stored bytewise");
+
+// Whole file in memory, mapped where the platform allows so that only the
+// pages touched are read
+struct MappedFile {
+  const std::uint8_t *data = nullptr;
+  std::size_t size = 0;
+#ifdef _WIN32
+  std::string contents;
+#endif
+
+  MappedFile(const std::string &path);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+};
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &path) {
+  std::ifstream infile(path, std::ios::binary);
+  if (!infile)
+    return;
+  contents.assign(std::istreambuf_iterator<char>(infile),
+                  std::istreambuf_iterator<char>());
+  data = reinterpret_cast<const std::uint8_t *>(contents.data());
+  size = contents.size();
+}
+
+MappedFile::~MappedFile() {}
+#else
+MappedFile::MappedFile(const std::string &path) {
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat status;
+  if (fstat(fd, &status) == 0 && status.st_size > 0) {
+    auto *mapping =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      data = static_cast<const std::uint8_t *>(mapping);
+      size = status.st_size;
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data != nullptr)
+    munmap(const_cast<std::uint8_t *>(data), size);
+}
+#endif
+
+// Files named by "mtllib" statements, looked up where load_obj() does
+std::vector<std::string> material_libraries(const std::string &source) {
+  std::vector<std::string> libraries;
+  std::istringstream lines(source);
+  std::string line;
+  while (std::getline(lines, line)) {
+    std::istringstream tokens(line);
+    std::string keyword, name;
+    if (tokens >> keyword && keyword == "mtllib")
+      while (tokens >> name)
+        libraries.push_back("./" + name);
+  }
+  return libraries;
+}
+} // namespace
+
+MeshCache::MeshCache(const std::string &directory) : directory(directory) {
+  make_directory(directory);
+}
+
+MeshData MeshCache::load(const std::string &filename) const {
+  const auto cache_path = path(filename);
+  MeshSource cached;
+  MeshData data;
+  const auto found = read(cache_path, cached, data);
+  if (found && cached.stamp == stamp(filename, cached.libraries))
+    return data;
+
+  // Stamps differ after a copy or a touch, so the contents decide
+  std::string contents;
+  if (!read_file(filename, contents))
+    throw std::runtime_error("obj file read failed: " + filename);
+  MeshSource source;
+  source.hash = hash(FNV_OFFSET_BASIS, contents);
+  source.libraries = material_libraries(contents);
+  // A missing library hashes as empty, as load_obj() only warns about it
+  for (const auto &library : source.libraries) {
+    contents.clear();
+    read_file(library, contents);
+    source.hash = hash(source.hash, contents);
+  }
+  source.stamp = stamp(filename, source.libraries);
+  if (!found || cached.hash != source.hash)
+    data = load_obj(filename);
+  write(cache_path, source, data);
+  return data;
+}
+
+std::string MeshCache::path(const std::string &filename) const {
+  return directory + "/" + filename + ".mesh";
+}
+
+std::uint64_t MeshCache::stamp(const std::string &filename,
+                               const std::vector<std::string> &libraries) {
+  auto value = file_stamp(hash(FNV_OFFSET_BASIS, filename), filename);
+  for (const auto &library : libraries)
+    value = file_stamp(hash(value, library), library);
+  return value;
+}
+
+bool MeshCache::read(const std::string &path, MeshSource &source,
+                     MeshData &data) const {
+  MappedFile file(path);
+  std::size_t offset = 0;
+  const auto take = [&file, &offset](void *target, std::size_t size) {
+    if (file.size - offset < size)
+      return false;
+    if (size > 0)
+      std::memcpy(target, file.data + offset, size);
+    offset += size;
+    return true;
+  };
+
+  MeshFileHeader header;
+  if (!take(&header, sizeof(header)) || header.magic != MESH_CACHE_MAGIC ||
+      header.version != MESH_CACHE_VERSION || header.lod_count == 0)
+    return false;
+  std::string libraries(header.libraries_size, '\0');
+  if (!take(&libraries[0], libraries.size()))
+    return false;
+  std::vector<std::uint32_t> lod_sizes(header.lod_count);
+  if (!take(lod_sizes.data(), sizeof(std::uint32_t) * lod_sizes.size()))
+    return false;
+
+  // Sizes are checked against the file before anything is allocated
+  std::size_t expected = offset +
+                         sizeof(Material) * header.material_count +
+                         sizeof(MeshVertex) * header.vertex_count +
+                         sizeof(glm::vec3) * header.bvh_triangle_count +
+                         sizeof(MeshBvhNode) * header.bvh_node_count;
+  for (const auto lod_size : lod_sizes)
+    expected += sizeof(GLuint) * lod_size;
+  if (expected != file.size)
+    return false;
+
+  data.materials.resize(header.material_count);
+  data.vertices.resize(header.vertex_count);
+  data.lods.resize(header.lod_count);
+  data.bvh.triangles.resize(header.bvh_triangle_count);
+  data.bvh.nodes.resize(header.bvh_node_count);
+  take(data.materials.data(), sizeof(Material) * data.materials.size());
+  take(data.vertices.data(), sizeof(MeshVertex) * data.vertices.size());
+  for (std::size_t i = 0; i < data.lods.size(); i++) {
+    data.lods[i].resize(lod_sizes[i]);
+    take(data.lods[i].data(), sizeof(GLuint) * lod_sizes[i]);
+  }
+  take(data.bvh.triangles.data(),
+       sizeof(glm::vec3) * data.bvh.triangles.size());
+  take(data.bvh.nodes.data(), sizeof(MeshBvhNode) * data.bvh.nodes.size());
+  data.bounding_box = header.bounding_box;
+  data.acmr_before = header.acmr_before;
+  data.acmr_after = header.acmr_after;
+
+  source.hash = header.source_hash;
+  source.stamp = header.source_stamp;
+  source.libraries.clear();
+  std::istringstream lines(libraries);
+  std::string line;
+  while (std::getline(lines, line))
+    source.libraries.push_back(line);
+  return true;
+}
+
+void MeshCache::write(const std::string &path, const MeshSource &source,
+                      const MeshData &data) const {
+  std::ofstream outfile(path, std::ios::binary);
+  if (!outfile)
+    return;
+  const auto put = [&outfile](const void *source, std::size_t size) {
+    outfile.write(reinterpret_cast<const char *>(source), size);
+  };
+
+  MeshFileHeader header = {};
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.source_hash = source.hash;
+  header.source_stamp = source.stamp;
+  header.material_count = data.materials.size();
+  header.vertex_count = data.vertices.size();
+  header.lod_count = data.lods.size();
+  header.bvh_triangle_count = data.bvh.triangles.size();
+  header.bvh_node_count = data.bvh.nodes.size();
+  header.acmr_before = data.acmr_before;
+  header.acmr_after = data.acmr_after;
+  std::string libraries;
+  for (const auto &library : source.libraries)
+    libraries += library + "\n";
+  header.libraries_size = libraries.size();
+  header.bounding_box = data.bounding_box;
+  put(&header, sizeof(header));
+  put(libraries.data(), libraries.size());
+  for (const auto &lod : data.lods) {
+    const std::uint32_t size = lod.size();
+    put(&size, sizeof(size));
+  }
+  put(data.materials.data(), sizeof(Material) * data.materials.size());
+  put(data.vertices.data(), sizeof(MeshVertex) * data.vertices.size());
+  for (const auto &lod : data.lods)
+    put(lod.data(), sizeof(GLuint) * lod.size());
+  put(data.bvh.triangles.data(),
+      sizeof(glm::vec3) * data.bvh.triangles.size());
+  put(data.bvh.nodes.data(), sizeof(MeshBvhNode) * data.bvh.nodes.size());
+}
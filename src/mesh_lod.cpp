@@ -0,0 +1,224 @@
+#include "mesh_lod.hpp"
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+// Symmetric 4x4 matrix, upper triangle in row order
+struct Quadric {
+  std::array<double, 10> a = {};
+
+  Quadric() = default;
+  Quadric(const glm::vec3 &normal, float d, float weight) {
+    const double n[4] = {normal[0], normal[1], normal[2], d};
+    std::size_t k = 0;
+    for (int i = 0; i < 4; i++)
+      for (int j = i; j < 4; j++)
+        a[k++] = weight * n[i] * n[j];
+  }
+
+  Quadric &operator+=(const Quadric &other) {
+    for (std::size_t i = 0; i < a.size(); i++)
+      a[i] += other.a[i];
+    return *this;
+  }
+
+  double error(const glm::vec3 &p) const {
+    const double v[4] = {p[0], p[1], p[2], 1};
+    double result = 0;
+    std::size_t k = 0;
+    for (int i = 0; i < 4; i++)
+      for (int j = i; j < 4; j++)
+        result += (i == j ? 1 : 2) * a[k++] * v[i] * v[j];
+    return result;
+  }
+};
+
+struct Collapse {
+  double cost;
+  GLuint from, to;
+  std::uint32_t from_version, to_version;
+
+  bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+const double BORDER_WEIGHT = 10;
+
+std::uint64_t edge_key(GLuint a, GLuint b) {
+  return (std::uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+}
+} // namespace
+
+std::vector<GLuint> simplify_mesh(const std::vector<glm::vec3> &positions,
+                                  const std::vector<GLuint> &indices,
+                                  const std::vector<bool> &locked,
+                                  std::size_t target_index_count) {
+  const auto vertex_count = positions.size();
+  const auto triangle_count = indices.size() / 3;
+  const auto position = [&](GLuint v) { return positions[v]; };
+  const auto normal = [&](GLuint a, GLuint b, GLuint c) {
+    return glm::cross(position(b) - position(a), position(c) - position(a));
+  };
+
+  std::vector<GLuint> triangles(indices.begin(),
+                                indices.begin() + 3 * triangle_count);
+  std::vector<bool> removed(triangle_count, false);
+  std::vector<std::vector<std::size_t>> adjacency(vertex_count);
+  std::vector<Quadric> quadrics(vertex_count);
+  std::unordered_map<std::uint64_t, int> edge_counts;
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    const auto *tri = &triangles[3 * t];
+    const auto n = normal(tri[0], tri[1], tri[2]);
+    const auto area = glm::length(n);
+    Quadric plane;
+    if (area > 0)
+      plane = Quadric(n / area, -glm::dot(n / area, position(tri[0])), area);
+    for (int i = 0; i < 3; i++) {
+      adjacency[tri[i]].push_back(t);
+      edge_counts[edge_key(tri[i], tri[(i + 1) % 3])]++;
+      quadrics[tri[i]] += plane;
+    }
+  }
+
+  // Vertices on open borders may only slide along them, held by planes
+  // perpendicular to their faces. Where borders meet they are locked.
+  std::vector<int> border_edges(vertex_count, 0);
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    const auto *tri = &triangles[3 * t];
+    const auto n = normal(tri[0], tri[1], tri[2]);
+    for (int i = 0; i < 3; i++) {
+      const auto a = tri[i], b = tri[(i + 1) % 3];
+      if (edge_counts[edge_key(a, b)] != 1)
+        continue;
+      border_edges[a]++;
+      border_edges[b]++;
+      const auto edge = position(b) - position(a);
+      const auto perpendicular = glm::cross(edge, n);
+      const auto length = glm::length(perpendicular);
+      if (length == 0)
+        continue;
+      const Quadric border(perpendicular / length,
+                           -glm::dot(perpendicular / length, position(a)),
+                           BORDER_WEIGHT * glm::dot(edge, edge));
+      quadrics[a] += border;
+      quadrics[b] += border;
+    }
+  }
+  std::vector<bool> fixed(vertex_count, false);
+  for (std::size_t v = 0; v < vertex_count; v++)
+    fixed[v] = (v < locked.size() && locked[v]) || border_edges[v] > 2;
+
+  std::vector<std::uint32_t> versions(vertex_count, 0);
+  std::vector<bool> collapsed(vertex_count, false);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>
+      heap;
+  const auto push = [&](GLuint from, GLuint to) {
+    if (fixed[from] ||
+        (border_edges[from] > 0 && edge_counts[edge_key(from, to)] != 1))
+      return;
+    auto quadric = quadrics[from];
+    quadric += quadrics[to];
+    heap.push({quadric.error(position(to)), from, to, versions[from],
+               versions[to]});
+  };
+  for (const auto &entry : edge_counts) {
+    const GLuint a = entry.first >> 32, b = entry.first & 0xffffffff;
+    push(a, b);
+    push(b, a);
+  }
+
+  auto live_count = triangle_count;
+  while (3 * live_count > target_index_count && !heap.empty()) {
+    const auto c = heap.top();
+    heap.pop();
+    if (collapsed[c.from] || collapsed[c.to] ||
+        versions[c.from] != c.from_version || versions[c.to] != c.to_version)
+      continue;
+
+    // Reject collapses that would fold a remaining triangle over
+    auto valid = true;
+    for (const auto t : adjacency[c.from]) {
+      const auto *tri = &triangles[3 * t];
+      if (removed[t] || tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+        continue;
+      GLuint moved[3];
+      for (int i = 0; i < 3; i++)
+        moved[i] = tri[i] == c.from ? c.to : tri[i];
+      const auto before = normal(tri[0], tri[1], tri[2]);
+      if (glm::dot(before, before) > 0 &&
+          glm::dot(before, normal(moved[0], moved[1], moved[2])) <= 0) {
+        valid = false;
+        break;
+      }
+    }
+    if (!valid)
+      continue;
+
+    for (const auto t : adjacency[c.from]) {
+      if (removed[t])
+        continue;
+      auto *tri = &triangles[3 * t];
+      if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+        removed[t] = true;
+        live_count--;
+        continue;
+      }
+      for (int i = 0; i < 3; i++)
+        if (tri[i] == c.from)
+          tri[i] = c.to;
+      adjacency[c.to].push_back(t);
+    }
+    quadrics[c.to] += quadrics[c.from];
+    collapsed[c.from] = true;
+    versions[c.to]++;
+
+    for (const auto t : adjacency[c.to]) {
+      if (removed[t])
+        continue;
+      for (int i = 0; i < 3; i++) {
+        const auto other = triangles[3 * t + i];
+        if (other == c.to)
+          continue;
+        push(c.to, other);
+        push(other, c.to);
+      }
+    }
+  }
+
+  std::vector<GLuint> result;
+  result.reserve(3 * live_count);
+  for (std::size_t t = 0; t < triangle_count; t++)
+    if (!removed[t])
+      result.insert(result.end(), &triangles[3 * t], &triangles[3 * t] + 3);
+  return result;
+}
+
+std::size_t select_lod(std::size_t current, std::size_t level_count,
+                       float screen_size) {
+  auto lod = std::min(current, level_count - 1);
+  while (lod + 1 < level_count &&
+         screen_size < LOD_SCREEN_SIZES[lod] * (1 - LOD_HYSTERESIS))
+    lod++;
+  while (lod > 0 &&
+         screen_size > LOD_SCREEN_SIZES[lod - 1] * (1 + LOD_HYSTERESIS))
+    lod--;
+  return lod;
+}
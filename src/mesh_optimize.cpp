@@ -0,0 +1,182 @@
+#include "mesh_optimize.hpp"
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+float acmr(const std::vector<GLuint> &indices, std::size_t vertex_count,
+           std::size_t cache_size) {
+  const auto triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+    return 0;
+  // Time each vertex entered the FIFO; it has left once cache_size newer
+  // ones came in
+  std::vector<std::size_t> entered(vertex_count, 0);
+  std::size_t time = cache_size + 1;
+  std::size_t misses = 0;
+  for (std::size_t i = 0; i < 3 * triangle_count; i++) {
+    const auto v = indices[i];
+    if (time - entered[v] > cache_size) {
+      entered[v] = time++;
+      misses++;
+    }
+  }
+  return float(misses) / triangle_count;
+}
+
+std::vector<GLuint> optimize_triangle_order(
+    const std::vector<glm::vec3> &positions, const std::vector<GLuint> &indices,
+    std::size_t cache_size) {
+  const auto vertex_count = positions.size();
+  const auto triangle_count = indices.size() / 3;
+
+  // Triangles around each vertex, packed behind per-vertex offsets
+  std::vector<std::size_t> offsets(vertex_count + 1, 0);
+  for (std::size_t i = 0; i < 3 * triangle_count; i++)
+    offsets[indices[i] + 1]++;
+  for (std::size_t v = 0; v < vertex_count; v++)
+    offsets[v + 1] += offsets[v];
+  std::vector<std::size_t> adjacency(offsets.back());
+  auto fill = offsets;
+  for (std::size_t i = 0; i < 3 * triangle_count; i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+
+  std::vector<std::size_t> live(vertex_count);
+  for (std::size_t v = 0; v < vertex_count; v++)
+    live[v] = offsets[v + 1] - offsets[v];
+  std::vector<std::size_t> cache_time(vertex_count, 0);
+  std::size_t time = cache_size + 1;
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<GLuint> dead_ends;
+  std::size_t cursor = 0;
+  // Most recently touched vertex with triangles left, else the next one in
+  // input order
+  const auto skip_dead_end = [&]() -> int {
+    while (!dead_ends.empty()) {
+      const auto v = dead_ends.back();
+      dead_ends.pop_back();
+      if (live[v] > 0)
+        return v;
+    }
+    for (; cursor < vertex_count; cursor++)
+      if (live[cursor] > 0)
+        return cursor;
+    return -1;
+  };
+
+  std::vector<std::size_t> order;
+  // Runs of the order broken by a dead end, sorted for overdraw below
+  std::vector<std::size_t> cluster_starts;
+  std::vector<GLuint> candidates;
+  auto fan = skip_dead_end();
+  cluster_starts.push_back(0);
+  while (fan >= 0) {
+    candidates.clear();
+    for (auto a = offsets[fan]; a < offsets[fan + 1]; a++) {
+      const auto t = adjacency[a];
+      if (emitted[t])
+        continue;
+      for (std::size_t k = 0; k < 3; k++) {
+        const auto v = indices[3 * t + k];
+        dead_ends.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cache_time[v] > cache_size)
+          cache_time[v] = time++;
+      }
+      emitted[t] = true;
+      order.push_back(t);
+    }
+
+    // Fan around the oldest neighbour that stays cached while its remaining
+    // triangles are emitted
+    int next = -1;
+    long best = -1;
+    for (const auto v : candidates) {
+      if (live[v] == 0)
+        continue;
+      long priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= cache_size)
+        priority = time - cache_time[v];
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+    if (next < 0) {
+      next = skip_dead_end();
+      if (next >= 0)
+        cluster_starts.push_back(order.size());
+    }
+    fan = next;
+  }
+  cluster_starts.push_back(order.size());
+
+  const auto area_normal = [&](std::size_t t) {
+    const auto &p0 = positions[indices[3 * t]];
+    return glm::cross(positions[indices[3 * t + 1]] - p0,
+                      positions[indices[3 * t + 2]] - p0);
+  };
+  const auto centroid = [&](std::size_t t) {
+    return (positions[indices[3 * t]] + positions[indices[3 * t + 1]] +
+            positions[indices[3 * t + 2]]) /
+           3.0f;
+  };
+  glm::vec3 mesh_centroid(0);
+  float mesh_area = 0;
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    const auto area = glm::length(area_normal(t));
+    mesh_centroid += centroid(t) * area;
+    mesh_area += area;
+  }
+  if (mesh_area > 0)
+    mesh_centroid = mesh_centroid / mesh_area;
+
+  struct Cluster {
+    std::size_t begin, end;
+    float facing;
+  };
+  std::vector<Cluster> clusters;
+  for (std::size_t c = 0; c + 1 < cluster_starts.size(); c++) {
+    Cluster cluster = {cluster_starts[c], cluster_starts[c + 1], 0};
+    if (cluster.begin == cluster.end)
+      continue;
+    glm::vec3 normal(0), center(0);
+    float area = 0;
+    for (auto i = cluster.begin; i < cluster.end; i++) {
+      const auto n = area_normal(order[i]);
+      normal += n;
+      center += centroid(order[i]) * glm::length(n);
+      area += glm::length(n);
+    }
+    const auto normal_length = glm::length(normal);
+    if (area > 0 && normal_length > 0)
+      cluster.facing = glm::dot(center / area - mesh_centroid,
+                                normal / normal_length);
+    clusters.push_back(cluster);
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.facing > b.facing;
+                   });
+
+  std::vector<GLuint> result;
+  result.reserve(3 * triangle_count);
+  for (const auto &cluster : clusters)
+    for (auto i = cluster.begin; i < cluster.end; i++)
+      for (std::size_t k = 0; k < 3; k++)
+        result.push_back(indices[3 * order[i] + k]);
+  return result;
+}
@@ -0,0 +1,105 @@
+#include "mesh_pool.hpp"
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "uniform_buffer.hpp"
+#include "vertex_format.hpp"
+
+IndirectCommand MeshRange::command(GLuint instance_count,
+                                   GLuint base_instance) const {
+  return {index_count, instance_count, first_index, base_vertex,
+          base_instance};
+}
+
+MeshRange MeshPool::add(const std::vector<MeshVertex> &vertices,
+                        const std::vector<GLuint> &indices) {
+  MeshRange range;
+  range.first_index = this->indices.size();
+  range.index_count = indices.size();
+  range.base_vertex = this->vertices.size();
+  this->vertices.insert(this->vertices.end(), vertices.begin(),
+                        vertices.end());
+  this->indices.insert(this->indices.end(), indices.begin(), indices.end());
+  return range;
+}
+
+MeshRange MeshPool::add(const MeshRange &base,
+                        const std::vector<GLuint> &indices) {
+  MeshRange range;
+  range.first_index = this->indices.size();
+  range.index_count = indices.size();
+  range.base_vertex = base.base_vertex;
+  this->indices.insert(this->indices.end(), indices.begin(), indices.end());
+  return range;
+}
+
+GLuint MeshPool::add_materials(const std::vector<Material> &materials) {
+  const GLuint base = this->materials.size();
+  if (base + materials.size() > MAX_MATERIALS)
+    throw std::runtime_error("too many materials for the material table");
+  this->materials.insert(this->materials.end(), materials.begin(),
+                         materials.end());
+  return base;
+}
+
+void MeshPool::upload() {
+  glGenVertexArrays(1, &vao_id);
+  glBindVertexArray(vao_id);
+
+  position_format = ::position_format(vertices);
+  const auto packed = pack_vertices(vertices, position_format);
+  glGenBuffers(1, &vertex_buffer_id);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+  glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &index_buffer_id);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(),
+               indices.data(), GL_STATIC_DRAW);
+
+  bind_vertex_layout(position_format);
+  glGenBuffers(1, &instance_buffer_id);
+  bind_instance_layout(instance_buffer_id, 0);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  auto table = materials;
+  table.resize(MAX_MATERIALS);
+  material_uniforms =
+      UniformBuffer(MATERIAL_UNIFORM_BINDING, sizeof(Material) * MAX_MATERIALS);
+  material_uniforms.update(table.data());
+}
+
+void MeshPool::bind_instances(GLuint buffer_id, std::size_t offset) const {
+  glBindVertexArray(vao_id);
+  bind_instance_layout(buffer_id, offset);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshPool::bind_instance_layout(GLuint buffer_id, std::size_t offset) {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+  for (GLuint i = 0; i < 4; i++) {
+    glVertexAttribPointer(9 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void *)(offset + i * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(9 + i);
+    glVertexAttribDivisor(9 + i, 1);
+  }
+  glVertexAttribIPointer(13, 2, GL_UNSIGNED_INT, sizeof(Instance),
+                         (void *)(offset + offsetof(Instance, texture)));
+  glEnableVertexAttribArray(13);
+  glVertexAttribDivisor(13, 1);
+}
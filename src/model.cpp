@@ -1,5 +1,7 @@
 #include "model.hpp"
 
+#include <tiny_obj_loader.h>
+
 #include <glm/glm.hpp>
 
 #ifdef __APPLE__
@@ -13,159 +15,209 @@
 #endif
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "bounding_box.hpp"
+#include "file_util.hpp"
+#include "mesh_bvh.hpp"
+#include "mesh_lod.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_pool.hpp"
+#include "vertex_format.hpp"
+
+namespace {
+// Attributes that make two face corners the same vertex
+struct VertexKey {
+  glm::vec3 pos;
+  glm::vec3 normal;
+  glm::vec2 uv;
+  GLuint material;
+
+  bool operator==(const VertexKey &other) const {
+    return std::memcmp(this, &other, sizeof(VertexKey)) == 0;
+  }
+};
 
-Model::Model(const tinyobj::attrib_t &attrib,
-             const std::vector<tinyobj::shape_t> &shapes,
-             const std::vector<tinyobj::material_t> &materials) {
-  const auto vertex_count = attrib.vertices.size() / 3;
-  const auto stride_units = 24;
-  std::vector<GLfloat> buffer_data(stride_units * vertex_count);
-  for (std::size_t i = 0; i < vertex_count; i++)
-    for (std::size_t j = 0; j < 3; j++)
-      buffer_data[stride_units * i + j] = attrib.vertices[3 * i + j];
-
-  std::vector<GLuint> vertex_indices;
-  for (std::size_t s = 0; s < shapes.size(); s++) {
-    std::size_t index_offset = 0;
-    for (std::size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-      const auto fv = shapes[s].mesh.num_face_vertices[f];
-      const auto material_id = shapes[s].mesh.material_ids[f];
-      const auto material = materials[material_id];
-      for (std::size_t v = 0; v < fv; v++) {
-        const auto index = shapes[s].mesh.indices[index_offset + v];
-        const auto vertex_index = index.vertex_index;
-        vertex_indices.push_back(vertex_index);
-
-        const auto normal_index = index.normal_index;
-        if (normal_index >= 0)
-          for (std::size_t i = 0; i < 3; i++)
-            buffer_data[stride_units * vertex_index + 3 + i] =
-                attrib.normals[3 * normal_index + i];
-
-        for (std::size_t i = 0; i < 3; i++)
-          buffer_data[stride_units * vertex_index + 6 + i] =
-              material.ambient[i];
-
-        for (std::size_t i = 0; i < 3; i++)
-          buffer_data[stride_units * vertex_index + 9 + i] =
-              material.diffuse[i];
-
-        for (std::size_t i = 0; i < 3; i++)
-          buffer_data[stride_units * vertex_index + 12 + i] =
-              material.specular[i];
-
-        buffer_data[stride_units * vertex_index + 15] =
-            std::max(material.shininess, 1.0f);
-
-        const auto texcoord_index = index.texcoord_index;
-        if (texcoord_index >= 0)
-          for (std::size_t i = 0; i < 2; i++)
-            buffer_data[stride_units * vertex_index + 16 + i] =
-                attrib.texcoords[2 * texcoord_index + i];
+static_assert(sizeof(VertexKey) == 8 * sizeof(float) + sizeof(GLuint),
+              "VertexKey is compared bytewise");
+
+// FNV-1a over the key's bytes
+struct VertexKeyHash {
+  std::size_t operator()(const VertexKey &key) const {
+    return fnv1a(FNV_OFFSET_BASIS, &key, sizeof(VertexKey));
+  }
+};
+} // namespace
+
+MeshData load_obj(const std::string &filename) {
+  tinyobj::ObjReaderConfig reader_config;
+  reader_config.mtl_search_path = "./";
+  tinyobj::ObjReader reader;
+
+  if (!reader.ParseFromFile(filename, reader_config))
+    throw std::runtime_error("obj file parse failed");
+
+  if (!reader.Warning().empty())
+    std::cout << "TinyObjReader: " << reader.Warning();
+
+  const auto &attrib = reader.GetAttrib();
+  const auto &shapes = reader.GetShapes();
+  const auto &materials = reader.GetMaterials();
+  MeshData data;
+
+  // Faces without a material use the last entry
+  auto &material_table = data.materials;
+  for (const auto &material : materials)
+    material_table.push_back(
+        {glm::vec4(material.ambient[0], material.ambient[1],
+                   material.ambient[2], 1),
+         glm::vec4(material.diffuse[0], material.diffuse[1],
+                   material.diffuse[2], 1),
+         glm::vec4(material.specular[0], material.specular[1],
+                   material.specular[2], std::max(material.shininess, 1.0f))});
+  material_table.push_back(
+      {glm::vec4(0, 0, 0, 1), glm::vec4(1), glm::vec4(0, 0, 0, 1)});
+
+  // Corners with equal position, normal, UV and material share one vertex
+  auto &vertices = data.vertices;
+  std::vector<GLuint> indices;
+  std::unordered_map<VertexKey, GLuint, VertexKeyHash> welded;
+  // OBJ positions, kept for the bounds and the BVH
+  std::vector<GLuint> position_indices;
+  // Welded vertex first made from each OBJ position; positions split into
+  // several vertices are seams and must survive simplification
+  const auto position_count = attrib.vertices.size() / 3;
+  std::vector<int> first_vertex(position_count, -1);
+  std::vector<bool> seams;
+  const auto weld = [&](const tinyobj::index_t &index, GLuint material) {
+    VertexKey key = {};
+    const auto p = index.vertex_index, n = index.normal_index,
+               t = index.texcoord_index;
+    key.pos = glm::vec3(attrib.vertices[3 * p], attrib.vertices[3 * p + 1],
+                        attrib.vertices[3 * p + 2]);
+    if (n >= 0)
+      key.normal = glm::vec3(attrib.normals[3 * n], attrib.normals[3 * n + 1],
+                             attrib.normals[3 * n + 2]);
+    if (t >= 0)
+      key.uv = glm::vec2(attrib.texcoords[2 * t], attrib.texcoords[2 * t + 1]);
+    key.material = material;
+
+    auto it = welded.find(key);
+    if (it == welded.end()) {
+      it = welded.emplace(key, vertices.size()).first;
+      MeshVertex vertex;
+      vertex.pos = key.pos;
+      vertex.normal = key.normal;
+      vertex.uv = key.uv;
+      vertex.material = material;
+      vertices.push_back(vertex);
+      seams.push_back(false);
+      if (first_vertex[p] < 0) {
+        first_vertex[p] = it->second;
+      } else {
+        seams[first_vertex[p]] = true;
+        seams[it->second] = true;
       }
-      if (fv >= 3) {
-        const auto index0 = shapes[s].mesh.indices[index_offset].vertex_index,
-                   index1 =
-                       shapes[s].mesh.indices[index_offset + 1].vertex_index,
-                   index2 =
-                       shapes[s].mesh.indices[index_offset + 2].vertex_index;
-        const glm::vec3 v0 = {attrib.vertices[3 * index0],
-                              attrib.vertices[3 * index0 + 1],
-                              attrib.vertices[3 * index0 + 2]},
-                        v1 = {attrib.vertices[3 * index1],
-                              attrib.vertices[3 * index1 + 1],
-                              attrib.vertices[3 * index1 + 2]},
-                        v2 = {attrib.vertices[3 * index2],
-                              attrib.vertices[3 * index2 + 1],
-                              attrib.vertices[3 * index2 + 2]};
-        const auto texindex0 =
-                       shapes[s].mesh.indices[index_offset].texcoord_index,
-                   texindex1 =
-                       shapes[s].mesh.indices[index_offset + 1].texcoord_index,
-                   texindex2 =
-                       shapes[s].mesh.indices[index_offset + 2].texcoord_index;
-        const glm::vec2 uv0 = {attrib.texcoords[2 * texindex0],
-                               attrib.texcoords[2 * texindex0 + 1]},
-                        uv1 = {attrib.texcoords[2 * texindex1],
-                               attrib.texcoords[2 * texindex1 + 1]},
-                        uv2 = {attrib.texcoords[2 * texindex2],
-                               attrib.texcoords[2 * texindex2 + 1]};
-        const auto delta_pos1 = v1 - v0, delta_pos2 = v2 - v0;
-        const auto delta_uv1 = uv1 - uv0, delta_uv2 = uv2 - uv0;
-        float r =
-            1.0f / (delta_uv1.x * delta_uv2.y - delta_uv1.y * delta_uv2.x);
-        const auto tangent =
-                       (delta_pos1 * delta_uv2.y - delta_pos2 * delta_uv1.y) *
-                       r,
-                   bitangent =
-                       (delta_pos2 * delta_uv1.x - delta_pos1 * delta_uv2.x) *
-                       r;
-        for (std::size_t i = 0; i < 3; i++) {
-          buffer_data[stride_units * index0 + 18 + i] = tangent[i];
-          buffer_data[stride_units * index1 + 18 + i] = tangent[i];
-          buffer_data[stride_units * index2 + 18 + i] = tangent[i];
-          buffer_data[stride_units * index0 + 21 + i] = bitangent[i];
-          buffer_data[stride_units * index1 + 21 + i] = bitangent[i];
-          buffer_data[stride_units * index2 + 21 + i] = bitangent[i];
-        }
+    }
+    indices.push_back(it->second);
+    position_indices.push_back(p);
+  };
+
+  for (const auto &shape : shapes) {
+    std::size_t index_offset = 0;
+    for (std::size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+      const std::size_t fv = shape.mesh.num_face_vertices[f];
+      const auto material_id = shape.mesh.material_ids[f];
+      const GLuint material =
+          material_id >= 0 ? material_id : materials.size();
+      // Polygons left untriangulated are split into fans
+      for (std::size_t v = 2; v < fv; v++) {
+        weld(shape.mesh.indices[index_offset], material);
+        weld(shape.mesh.indices[index_offset + v - 1], material);
+        weld(shape.mesh.indices[index_offset + v], material);
       }
       index_offset += fv;
     }
   }
-  index_count = vertex_indices.size();
-  bounding_box =
-      BoundingBox3D::from_vertex_index_array(attrib.vertices, vertex_indices);
-
-  const auto buffer_elem_size = sizeof(decltype(buffer_data)::value_type);
-  GLuint buffer_id;
-  glGenBuffers(1, &buffer_id);
-  glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
-  glBufferData(GL_ARRAY_BUFFER, buffer_elem_size * buffer_data.size(),
-               buffer_data.data(), GL_STATIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  const auto index_elem_size = sizeof(decltype(vertex_indices)::value_type);
-  GLuint element_buffer_id;
-  glGenBuffers(1, &element_buffer_id);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_id);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_elem_size * vertex_indices.size(),
-               vertex_indices.data(), GL_STATIC_DRAW);
-
-  glGenVertexArrays(1, &vao_id);
-  glBindVertexArray(vao_id);
-  glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_id);
-
-  const auto stride_size = stride_units * buffer_elem_size;
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride_size, (void *)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(3 * buffer_elem_size));
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(6 * buffer_elem_size));
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(9 * buffer_elem_size));
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(12 * buffer_elem_size));
-  glEnableVertexAttribArray(4);
-  glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(15 * buffer_elem_size));
-  glEnableVertexAttribArray(5);
-  glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(16 * buffer_elem_size));
-  glEnableVertexAttribArray(6);
-  glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(18 * buffer_elem_size));
-  glEnableVertexAttribArray(7);
-  glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, stride_size,
-                        (void *)(21 * buffer_elem_size));
-  glEnableVertexAttribArray(8);
-  glBindVertexArray(0);
+
+  // Tangent frames summed over every triangle around a vertex, then made
+  // orthogonal to its normal
+  std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0)),
+      bitangents(vertices.size(), glm::vec3(0));
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const auto &v0 = vertices[indices[i]], &v1 = vertices[indices[i + 1]],
+               &v2 = vertices[indices[i + 2]];
+    const auto delta_pos1 = v1.pos - v0.pos, delta_pos2 = v2.pos - v0.pos;
+    const auto delta_uv1 = v1.uv - v0.uv, delta_uv2 = v2.uv - v0.uv;
+    const auto determinant =
+        delta_uv1.x * delta_uv2.y - delta_uv1.y * delta_uv2.x;
+    if (std::abs(determinant) < 1e-12f)
+      continue;
+    const auto r = 1.0f / determinant;
+    const auto tangent =
+                   (delta_pos1 * delta_uv2.y - delta_pos2 * delta_uv1.y) * r,
+               bitangent =
+                   (delta_pos2 * delta_uv1.x - delta_pos1 * delta_uv2.x) * r;
+    for (std::size_t k = 0; k < 3; k++) {
+      tangents[indices[i + k]] += tangent;
+      bitangents[indices[i + k]] += bitangent;
+    }
+  }
+  for (std::size_t i = 0; i < vertices.size(); i++) {
+    auto &vertex = vertices[i];
+    const auto &normal = vertex.normal;
+    auto tangent = tangents[i] - normal * glm::dot(normal, tangents[i]);
+    if (glm::length(tangent) < 1e-6f)
+      tangent = glm::cross(normal, std::abs(normal.x) < 0.9f
+                                       ? glm::vec3(1, 0, 0)
+                                       : glm::vec3(0, 1, 0));
+    tangent = glm::normalize(tangent);
+    // Only the bitangent's handedness is stored; shaders rebuild it from the
+    // normal and tangent
+    const auto handedness =
+        glm::dot(glm::cross(normal, tangent), bitangents[i]);
+    vertex.tangent = glm::vec4(tangent, handedness < 0 ? -1.0f : 1.0f);
+  }
+
+  data.bounding_box =
+      BoundingBox3D::from_vertex_index_array(attrib.vertices, position_indices);
+  data.bvh = MeshBvh(attrib.vertices, position_indices);
+
+  std::vector<glm::vec3> positions(vertices.size());
+  for (std::size_t i = 0; i < vertices.size(); i++)
+    positions[i] = vertices[i].pos;
+  data.lods.push_back(optimize_triangle_order(positions, indices));
+  data.acmr_before = acmr(indices, vertices.size());
+  data.acmr_after = acmr(data.lods.front(), vertices.size());
+
+  while (data.lods.size() < LOD_COUNT) {
+    const auto &previous = data.lods.back();
+    const auto simplified = simplify_mesh(positions, previous, seams,
+                                          LOD_REDUCTION * previous.size());
+    // Stop once seams and boundaries leave little to remove
+    if (simplified.size() > 0.8f * previous.size())
+      break;
+    data.lods.push_back(optimize_triangle_order(positions, simplified));
+  }
+  return data;
+}
+
+Model::Model(const MeshData &data, MeshPool &pool)
+    : bounding_box(data.bounding_box), bvh(data.bvh),
+      acmr_before(data.acmr_before), acmr_after(data.acmr_after) {
+  const auto material_base = pool.add_materials(data.materials);
+  auto vertices = data.vertices;
+  for (auto &vertex : vertices)
+    vertex.material += material_base;
+  lods.push_back(pool.add(vertices, data.lods.front()));
+  for (std::size_t i = 1; i < data.lods.size(); i++)
+    lods.push_back(pool.add(lods.front(), data.lods[i]));
 }
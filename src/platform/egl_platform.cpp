@@ -0,0 +1,116 @@
+#include "platform/egl_platform.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+using namespace platform;
+
+namespace {
+bool has_extension(const char *extensions, const char *name) {
+  if (extensions == nullptr)
+    return false;
+  const auto length = std::strlen(name);
+  for (auto p = std::strstr(extensions, name); p != nullptr;
+       p = std::strstr(p + length, name))
+    if ((p == extensions || p[-1] == ' ') &&
+        (p[length] == ' ' || p[length] == '\0'))
+      return true;
+  return false;
+}
+
+EGLDisplay open_display() {
+  // Mesa's surfaceless platform needs no X or Wayland server
+  const auto client_extensions =
+      eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+    const auto get_platform_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display != nullptr) {
+      const auto display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                                EGL_DEFAULT_DISPLAY, nullptr);
+      if (display != EGL_NO_DISPLAY)
+        return display;
+    }
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+} // namespace
+
+EglPlatform::EglPlatform(const Config &config)
+    : Platform(config.width, config.height), _display(open_display()),
+      _context(EGL_NO_CONTEXT), _framebuffer_id(0), _color_buffer_id(0),
+      _depth_buffer_id(0) {
+  if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, nullptr, nullptr))
+    throw std::runtime_error("EGL display init failed");
+  if (!eglBindAPI(EGL_OPENGL_API))
+    throw std::runtime_error("EGL has no desktop GL support");
+
+  const EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                   EGL_NONE};
+  EGLConfig egl_config;
+  EGLint config_count = 0;
+  if (!eglChooseConfig(_display, config_attribs, &egl_config, 1,
+                       &config_count) ||
+      config_count == 0)
+    throw std::runtime_error("no usable EGL config");
+
+  _context = eglCreateContext(_display, egl_config, EGL_NO_CONTEXT, nullptr);
+  if (_context == EGL_NO_CONTEXT)
+    throw std::runtime_error("EGL context creation failed");
+  if (!eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context))
+    throw std::runtime_error("EGL context without a surface not supported");
+
+#ifndef __APPLE__
+  // glewInit expects a GLX display; only the GL entry points are needed here
+  glewExperimental = GL_TRUE;
+  if (glewContextInit() != GLEW_OK)
+    throw std::runtime_error("GLEW init error");
+#endif
+
+  glGenRenderbuffers(1, &_color_buffer_id);
+  glBindRenderbuffer(GL_RENDERBUFFER, _color_buffer_id);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+  glGenRenderbuffers(1, &_depth_buffer_id);
+  glBindRenderbuffer(GL_RENDERBUFFER, _depth_buffer_id);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _width, _height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &_framebuffer_id);
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer_id);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, _color_buffer_id);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, _depth_buffer_id);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    throw std::runtime_error("offscreen framebuffer incomplete");
+  glViewport(0, 0, _width, _height);
+}
+
+EglPlatform::~EglPlatform() {
+  glDeleteFramebuffers(1, &_framebuffer_id);
+  glDeleteRenderbuffers(1, &_color_buffer_id);
+  glDeleteRenderbuffers(1, &_depth_buffer_id);
+  eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(_display, _context);
+  eglTerminate(_display);
+}
+
+void EglPlatform::run(const std::function<bool()> &frame) {
+  while (frame())
+    ;
+}
+
+// No presentation; flushing keeps the GPU timer queries moving
+void EglPlatform::swap_buffers() { glFlush(); }
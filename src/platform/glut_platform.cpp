@@ -0,0 +1,80 @@
+#include "platform/glut_platform.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+using namespace platform;
+
+std::function<bool()> GlutPlatform::_frame;
+std::function<void(unsigned char)> GlutPlatform::_key_handler;
+std::function<void(int)> GlutPlatform::_special_key_handler;
+
+GlutPlatform::GlutPlatform(int &argc, char **argv, const Config &config)
+    : Platform(config.width, config.height) {
+  glutInit(&argc, argv);
+  const unsigned int multisample = config.multisample ? GLUT_MULTISAMPLE : 0;
+#ifdef __APPLE__
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | multisample |
+                      GLUT_3_2_CORE_PROFILE);
+#else
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | multisample);
+#endif
+  glutInitWindowSize(config.width, config.height);
+  glutCreateWindow(config.title.c_str());
+
+#ifndef __APPLE__
+  const auto init_status = glewInit();
+  if (init_status != GLEW_OK)
+    throw std::runtime_error(
+        std::string("GLEW init error: ") +
+        reinterpret_cast<const char *>(glewGetErrorString(init_status)));
+#endif
+}
+
+void GlutPlatform::display() {
+  if (!_frame())
+    std::exit(0);
+}
+
+void GlutPlatform::idle() { glutPostRedisplay(); }
+
+void GlutPlatform::keyboard(unsigned char key, int x, int y) {
+  if (_key_handler)
+    _key_handler(key);
+}
+
+void GlutPlatform::special(int key, int x, int y) {
+  if (_special_key_handler)
+    _special_key_handler(key);
+}
+
+void GlutPlatform::run(const std::function<bool()> &frame) {
+  _frame = frame;
+  glutDisplayFunc(display);
+  glutIdleFunc(idle);
+  glutKeyboardFunc(keyboard);
+  glutSpecialFunc(special);
+  glutMainLoop();
+}
+
+void GlutPlatform::swap_buffers() { glutSwapBuffers(); }
+
+void GlutPlatform::on_key(const std::function<void(unsigned char)> &handler) {
+  _key_handler = handler;
+}
+
+void GlutPlatform::on_special_key(const std::function<void(int)> &handler) {
+  _special_key_handler = handler;
+}
@@ -0,0 +1,114 @@
+#include "platform/platform.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "platform/glut_platform.hpp"
+#ifdef HAS_EGL
+#include "platform/egl_platform.hpp"
+#endif
+
+using namespace platform;
+
+Platform::Platform(int width, int height) : _width(width), _height(height) {}
+
+Platform::~Platform() {}
+
+int Platform::width() const { return _width; }
+
+int Platform::height() const { return _height; }
+
+void Platform::on_key(const std::function<void(unsigned char)> &handler) {}
+
+void Platform::on_special_key(const std::function<void(int)> &handler) {}
+
+std::vector<std::uint8_t> Platform::read_pixels() const {
+  const std::size_t row_size = 4 * _width;
+  std::vector<std::uint8_t> pixels(row_size * _height);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE,
+               pixels.data());
+  // GL reads bottom to top
+  for (int i = 0; i < _height / 2; i++)
+    std::swap_ranges(pixels.begin() + i * row_size,
+                     pixels.begin() + (i + 1) * row_size,
+                     pixels.begin() + (_height - 1 - i) * row_size);
+  return pixels;
+}
+
+void Platform::write_png(const std::string &path) const {
+  const auto pixels = read_pixels();
+  if (!stbi_write_png(path.c_str(), _width, _height, 4, pixels.data(),
+                      4 * _width))
+    throw std::runtime_error("png write failed: " + path);
+}
+
+std::unique_ptr<Platform> platform::create(int &argc, char **argv,
+                                           const Config &config) {
+  if (config.headless) {
+#ifdef HAS_EGL
+    return std::unique_ptr<Platform>(new EglPlatform(config));
+#else
+    throw std::runtime_error("built without headless rendering support");
+#endif
+  }
+  return std::unique_ptr<Platform>(new GlutPlatform(argc, argv, config));
+}
+
+BenchmarkOptions BenchmarkOptions::parse(int &argc, char **argv) {
+  BenchmarkOptions options;
+  int kept = 1;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const auto has_value = i + 1 < argc;
+    if (arg == "--headless") {
+      options.headless = true;
+    } else if (arg == "--size" && has_value) {
+      const std::string size = argv[++i];
+      const auto x = size.find('x');
+      if (x == std::string::npos)
+        throw std::invalid_argument("--size expects WxH");
+      options.width = std::stoi(size.substr(0, x));
+      options.height = std::stoi(size.substr(x + 1));
+    } else if (arg == "--frames" && has_value) {
+      options.frames = std::stoul(argv[++i]);
+    } else if (arg == "--seed" && has_value) {
+      options.seed = std::stoul(argv[++i]);
+      options.seeded = true;
+    } else if (arg == "--dump" && has_value) {
+      options.dump_path = argv[++i];
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  return options;
+}
+
+Config BenchmarkOptions::config(const std::string &title) const {
+  Config config;
+  config.title = title;
+  config.width = width;
+  config.height = height;
+  config.headless = headless;
+  return config;
+}
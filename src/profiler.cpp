@@ -0,0 +1,243 @@
+#include "profiler.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TimeHistogram::TimeHistogram() : buckets(BUCKET_COUNT + 1, 0) {}
+
+void TimeHistogram::add(float ms) {
+  // The last bucket collects everything past the histogram's range
+  const auto bucket = std::min(static_cast<std::size_t>(ms / BUCKET_MS),
+                               BUCKET_COUNT);
+  buckets[bucket]++;
+  count++;
+  max = std::max(max, ms);
+  total += ms;
+}
+
+float TimeHistogram::percentile(float p) const {
+  if (count == 0)
+    return 0.0f;
+  const auto rank = std::max<std::size_t>(1, std::ceil(p * count));
+  std::size_t seen = 0;
+  for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+    seen += buckets[i];
+    if (seen >= rank)
+      return std::min((i + 1) * BUCKET_MS, max);
+  }
+  return max;
+}
+
+float TimeHistogram::mean() const { return count ? total / count : 0.0f; }
+
+void TimeHistogram::clear() { *this = TimeHistogram(); }
+
+void CountStats::add(std::size_t value) {
+  count++;
+  max = std::max(max, value);
+  total += value;
+}
+
+float CountStats::mean() const {
+  return count ? static_cast<float>(total) / count : 0.0f;
+}
+
+void GpuTimer::begin(std::size_t frame) {
+  if (queries[0] == 0)
+    glGenQueries(QUERY_COUNT, queries.data());
+  active = !pending[next];
+  if (!active)
+    return;
+  frames[next] = frame;
+  glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+}
+
+void GpuTimer::end() {
+  if (!active)
+    return;
+  active = false;
+  glEndQuery(GL_TIME_ELAPSED);
+  pending[next] = true;
+  next = (next + 1) % QUERY_COUNT;
+}
+
+bool GpuTimer::poll(float &ms, std::size_t &frame) {
+  if (!pending[oldest])
+    return false;
+  GLint available = 0;
+  glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+    return false;
+  GLuint64 elapsed = 0;
+  glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &elapsed);
+  ms = elapsed / 1.0e6f;
+  frame = frames[oldest];
+  pending[oldest] = false;
+  oldest = (oldest + 1) % QUERY_COUNT;
+  return true;
+}
+
+void Profiler::record_cpu(const std::string &name, float ms) {
+  cpu_times[name].add(ms);
+  frame_cpu[name] += ms;
+}
+
+void Profiler::record_count(const std::string &name, std::size_t value) {
+  counts[name].add(value);
+  frame_counts[name] += value;
+}
+
+void Profiler::begin_gpu(const std::string &name) {
+  gpu_timers[name].begin(frame);
+}
+
+void Profiler::end_gpu(const std::string &name) { gpu_timers[name].end(); }
+
+void Profiler::end_frame() {
+  const auto now = Clock::now();
+  float frame_ms = 0.0f;
+  if (started) {
+    frame_ms =
+        std::chrono::duration<float, std::milli>(now - last_frame).count();
+    frame_times.add(frame_ms);
+  }
+  last_frame = now;
+  started = true;
+
+  for (auto &entry : gpu_timers) {
+    float ms;
+    std::size_t sample_frame;
+    while (entry.second.poll(ms, sample_frame)) {
+      gpu_times[entry.first].add(ms);
+      frame_gpu[entry.first][sample_frame] += ms;
+    }
+  }
+
+  if (csv)
+    write_csv_row(frame_ms);
+  frame_cpu.clear();
+  frame_counts.clear();
+  frame_gpu.clear();
+  frame++;
+}
+
+void Profiler::open_csv(const std::string &path) {
+  csv = std::make_shared<std::ofstream>(path);
+  if (!*csv)
+    throw std::runtime_error("cannot open profile csv: " + path);
+  csv_cpu_columns.clear();
+  csv_count_columns.clear();
+  csv_gpu_columns.clear();
+}
+
+std::string Profiler::report() const {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(2);
+  const auto line = [&](const std::string &name, const TimeHistogram &h) {
+    out << std::left << std::setw(16) << name << std::right
+        << " n=" << std::setw(6) << h.count << " mean=" << std::setw(7)
+        << h.mean() << " p50=" << std::setw(7) << h.percentile(0.5f)
+        << " p95=" << std::setw(7) << h.percentile(0.95f)
+        << " p99=" << std::setw(7) << h.percentile(0.99f)
+        << " max=" << std::setw(7) << h.max << " ms\n";
+  };
+  line("frame", frame_times);
+  for (const auto &entry : cpu_times)
+    line("cpu " + entry.first, entry.second);
+  for (const auto &entry : gpu_times)
+    line("gpu " + entry.first, entry.second);
+  for (const auto &entry : counts)
+    out << std::left << std::setw(16) << entry.first << std::right
+        << " n=" << std::setw(6) << entry.second.count
+        << " mean=" << std::setw(7) << entry.second.mean()
+        << " max=" << std::setw(7) << entry.second.max << "\n";
+  return out.str();
+}
+
+void Profiler::clear() {
+  frame_times.clear();
+  for (auto &entry : cpu_times)
+    entry.second.clear();
+  for (auto &entry : gpu_times)
+    entry.second.clear();
+  for (auto &entry : counts)
+    entry.second = CountStats();
+}
+
+void Profiler::write_csv_row(float frame_ms) {
+  // Columns are fixed by the first frame written
+  if (csv_cpu_columns.empty() && csv_count_columns.empty() &&
+      csv_gpu_columns.empty()) {
+    *csv << "frame,frame_ms";
+    for (const auto &entry : frame_cpu) {
+      csv_cpu_columns.push_back(entry.first);
+      *csv << ",cpu_" << entry.first << "_ms";
+    }
+    for (const auto &entry : frame_counts) {
+      csv_count_columns.push_back(entry.first);
+      *csv << "," << entry.first;
+    }
+    // GPU samples arrive a few frames late, tagged with their own frame
+    for (const auto &entry : gpu_timers) {
+      csv_gpu_columns.push_back(entry.first);
+      *csv << ",gpu_" << entry.first << "_frame,gpu_" << entry.first
+           << "_ms";
+    }
+    *csv << "\n";
+  }
+
+  // Several GPU samples of one timer may resolve in the same frame; the
+  // extra ones go on rows of their own with the CPU columns left empty
+  std::size_t row_count = 1;
+  for (const auto &entry : frame_gpu)
+    row_count = std::max(row_count, entry.second.size());
+  for (std::size_t row = 0; row < row_count; row++) {
+    *csv << frame << ",";
+    if (row == 0)
+      *csv << frame_ms;
+    for (const auto &name : csv_cpu_columns) {
+      const auto it = frame_cpu.find(name);
+      *csv << ",";
+      if (row == 0)
+        *csv << (it == frame_cpu.end() ? 0.0f : it->second);
+    }
+    for (const auto &name : csv_count_columns) {
+      const auto it = frame_counts.find(name);
+      *csv << ",";
+      if (row == 0)
+        *csv << (it == frame_counts.end() ? 0 : it->second);
+    }
+    for (const auto &name : csv_gpu_columns) {
+      const auto it = frame_gpu.find(name);
+      if (it == frame_gpu.end() || it->second.size() <= row) {
+        *csv << ",,";
+        continue;
+      }
+      const auto sample = std::next(it->second.begin(), row);
+      *csv << "," << sample->first << "," << sample->second;
+    }
+    *csv << "\n";
+  }
+}
@@ -22,81 +22,179 @@
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
 
+#include "asset_loader.hpp"
+#include "asset_manager.hpp"
 #include "components.hpp"
+#include "frame_uniforms.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_pool.hpp"
+#include "render_queue.hpp"
+#include "shader_cache.hpp"
 #include "shader_program.hpp"
 #include "texture.hpp"
+#include "texture_array.hpp"
+#include "texture_cache.hpp"
+#include "texture_streamer.hpp"
+#include "uniform_buffer.hpp"
+#include "vertex_format.hpp"
+
+Registry::Registry(const LoadProgress &progress)
+    : asset_loader(AssetLoader::default_thread_count(), progress),
+      models(model_filenames.size()) {
+  // Shaders build in the background while the models load
+  ShaderCache shader_cache(SHADER_CACHE_DIRECTORY);
+  const std::vector<std::pair<std::string, std::string>> shader_filenames = {
+      {"gouraud.vert", "gouraud.frag"}, {"phong.vert", "phong.frag"}};
+  shader_variants.resize(shader_filenames.size());
+  for (std::size_t i = 0; i < shader_filenames.size(); i++) {
+    for (unsigned int features = 0; features < FEATURE_COMBINATIONS;
+         features++)
+      if ((features & shader_features[i]) == features)
+        shader_variants[i][features] = shader_cache.request(
+            shader_filenames[i].first, shader_filenames[i].second,
+            feature_defines(features));
+    // Features the shader ignores share the variant without them
+    for (unsigned int features = 0; features < FEATURE_COMBINATIONS;
+         features++)
+      shader_variants[i][features] =
+          shader_variants[i][features & shader_features[i]];
+  }
 
-Registry::Registry()
-    : models(model_filenames.size()), 
-      textures(texture_filenames.size() + normal_filenames.size()),
-      shader_programs(2) {
-  for (std::size_t i = 0; i < model_filenames.size(); i++) {
-    model_indices[model_filenames[i]] = i;
-
-    const auto &filename = model_filenames[i];
-    tinyobj::ObjReaderConfig reader_config;
-    reader_config.mtl_search_path = "./";
-    tinyobj::ObjReader reader;
-
-    if (!reader.ParseFromFile(filename, reader_config))
-      throw std::runtime_error("obj file parse failed");
-
-    if (!reader.Warning().empty())
-      std::cout << "TinyObjReader: " << reader.Warning();
-
-    models[i] =
-        Model(reader.GetAttrib(), reader.GetShapes(), reader.GetMaterials());
-
-    shader_programs[GOURAUD_SHADER] =
-        ShaderProgram("gouraud.vert", "gouraud.frag");
-    shader_programs[PHONG_SHADER] = ShaderProgram("phong.vert", "phong.frag");
+  for (const auto &filename : model_filenames)
+    model_assets.add(filename);
+  scene_assets.rooster = acquire_model(asset_id("rooster.obj"));
+  scene_assets.tree = acquire_model(asset_id("tree.obj"));
+  scene_assets.car = acquire_model(asset_id("car.obj"));
+  scene_assets.truck = acquire_model(asset_id("truck.obj"));
+  scene_assets.sneakers = acquire_model(asset_id("sneakers.obj"));
+  scene_assets.floor = acquire_model(asset_id("floor2.obj"));
+
+  // Binary meshes are built on the first run and mapped after. Every
+  // acquired model loads on the asset loader's threads while this one waits.
+  MeshCache mesh_cache(MESH_CACHE_DIRECTORY);
+  std::vector<std::string> filenames;
+  std::vector<std::size_t> indices;
+  for (std::size_t i = 0; i < model_assets.entries.size(); i++)
+    if (model_assets.entries[i].ref_count > 0) {
+      filenames.push_back(model_assets.entries[i].filename);
+      indices.push_back(i);
+    }
+  std::vector<MeshData> mesh_data(filenames.size());
+  asset_loader.load_all(
+      filenames,
+      [&mesh_cache](const std::string &filename) {
+        return mesh_cache.load(filename);
+      },
+      [&mesh_data](std::size_t i, MeshData &&data) {
+        mesh_data[i] = std::move(data);
+      });
+  // Added in a fixed order, so the pool layout does not depend on timing
+  for (std::size_t i = 0; i < indices.size(); i++) {
+    const auto &model = models[indices[i]] = Model(mesh_data[i], mesh_pool);
+    model_assets.entries[indices[i]].loaded = true;
+    std::cout << "ACMR of " << filenames[i] << ": " << model.acmr_before
+              << " -> " << model.acmr_after << std::endl;
+  }
 
-    std::cout << "Loaded obj file: " << filename << std::endl;
+  mesh_pool.upload();
+  shader_programs = shader_cache.finish();
+  if (shader_programs.size() > (1u << RenderKey::PROGRAM_BITS))
+    throw std::runtime_error("too many shader variants for the sort key");
+#ifndef __APPLE__
+  indirect_supported = GLEW_ARB_multi_draw_indirect && GLEW_ARB_draw_indirect &&
+                       GLEW_ARB_base_instance && GLEW_ARB_buffer_storage;
+#endif
+  indirect_draw = indirect_supported;
+
+  frame_uniforms = UniformBuffer(FRAME_UNIFORM_BINDING, sizeof(FrameUniforms));
+  for (const auto &shader_program : shader_programs) {
+    shader_program.bind_uniform_block("Frame", FRAME_UNIFORM_BINDING);
+    shader_program.bind_uniform_block("Materials", MATERIAL_UNIFORM_BINDING);
+    shader_program.bind_uniform_block("TextureSlots",
+                                      TEXTURE_SLOT_UNIFORM_BINDING);
   }
 
-  stbi_set_flip_vertically_on_load(true);
-  for (std::size_t i = 0; i < texture_filenames.size(); i++) {
-    const auto filename = texture_filenames[i];
-    texture_indicies[filename] = i;
+  // Storage is allocated from the image headers, with a placeholder bound
+  // for each texture until the streamer has sent its levels
+  TextureCache texture_cache(TEXTURE_CACHE_DIRECTORY);
+  std::vector<TextureRequest> requests;
+  for (const auto &filename : texture_filenames)
+    requests.push_back({filename, TextureKind::COLOR});
+  for (const auto &filename : normal_filenames)
+    requests.push_back({filename, TextureKind::NORMAL});
+  std::vector<TextureImage> descriptions;
+  for (const auto &request : requests) {
+    texture_assets.add(request.filename);
+    descriptions.push_back(
+        texture_cache.describe(request.filename, request.kind));
+  }
+  texture_arrays.build(descriptions);
+  texture_streamer =
+      TextureStreamer(texture_cache, requests, asset_loader.progress);
+
+  scene_assets.rooster_texture =
+      acquire_texture(asset_id("rooster_texture.jpg"));
+  scene_assets.tree_texture = acquire_texture(asset_id("tree_texture.png"));
+  scene_assets.car_texture = acquire_texture(asset_id("car_texture.png"));
+  scene_assets.truck_texture = acquire_texture(asset_id("truck_texture.jpg"));
+  scene_assets.ground_texture = acquire_texture(asset_id("ground_texture.jpg"));
+  scene_assets.road_texture = acquire_texture(asset_id("road_texture.jpg"));
+  scene_assets.empty_texture = acquire_texture(asset_id("empty_texture.png"));
+  scene_assets.empty_normal = acquire_texture(asset_id("empty_normal.png"));
+  scene_assets.ground_normal = acquire_texture(asset_id("ground_normal.jpg"));
+  scene_assets.road_normal = acquire_texture(asset_id("road_normal.png"));
+}
 
-    int width, height, channel_count;
-    std::uint8_t *texture_data =
-        stbi_load(filename.c_str(), &width, &height, &channel_count, 0);
-    if (texture_data == nullptr)
-      throw std::runtime_error("texture load failed");
-    textures[i] = Texture(texture_data, width, height, channel_count);
-    stbi_image_free(texture_data);
+ModelHandle Registry::acquire_model(AssetId id) {
+  const auto handle = model_assets.acquire(id);
+  const auto &entry = model_assets.entries[handle.index];
+  if (!entry.loaded && mesh_pool.vao_id != 0)
+    throw std::runtime_error("model acquired after the mesh pool upload: " +
+                             entry.filename);
+  return handle;
+}
 
-    std::cout << "Loaded texture file: " << filename << std::endl;
+TextureHandle Registry::acquire_texture(AssetId id) {
+  const auto handle = texture_assets.acquire(id);
+  auto &entry = texture_assets.entries[handle.index];
+  if (!entry.loaded) {
+    entry.loaded = true;
+    texture_streamer.request(handle.index, asset_loader);
   }
+  return handle;
+}
 
-  stbi_set_flip_vertically_on_load(true);
-  for (std::size_t i = 0; i < normal_filenames.size(); i++) {
-    auto idx = texture_filenames.size() + i;
-    const auto filename = normal_filenames[i];
-    texture_indicies[filename] = idx;
-
-    int width, height, channel_count;
-    std::uint8_t *texture_data =
-        stbi_load(filename.c_str(), &width, &height, &channel_count, 0);
-    if (texture_data == nullptr)
-      throw std::runtime_error("texture load failed");
-    textures[idx] = Texture(texture_data, width, height, channel_count);
-    stbi_image_free(texture_data);
-
-    std::cout << "Loaded texture file: " << filename << std::endl;
-  }
+std::size_t Registry::program_index(unsigned int features) const {
+  return shader_variants[shader_index][features];
 }
 
 ecs::entities::EntityId Registry::add_mesh(ecs::Context<Registry> &ctx,
-                                           components::Mesh &&mesh) {
+                                           const MeshAssets &assets,
+                                           const glm::mat4 &mat) {
   auto id = ctx.entity_manager().next_id();
-  meshes[id] = std::move(mesh);
+  mesh_assets[id] = {model_assets.retain(assets.model),
+                     texture_assets.retain(assets.texture),
+                     texture_assets.retain(assets.normal)};
+  meshes[id] = {model_assets.index(assets.model),
+                texture_assets.index(assets.texture),
+                texture_assets.index(assets.normal), mat};
   return id;
 }
 
+void Registry::remove_mesh(ecs::entities::EntityId id) {
+  const auto &assets = mesh_assets.at(id);
+  model_assets.release(assets.model);
+  texture_assets.release(assets.texture);
+  texture_assets.release(assets.normal);
+  mesh_assets.erase(id);
+  meshes.erase(id);
+}
+
 TileType Registry::random_tile_type(ecs::Context<Registry> &ctx) {
   return static_cast<TileType>(random_tile_type_dist(ctx.random_gen()));
 }
@@ -0,0 +1,99 @@
+#include "render_queue.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh_pool.hpp"
+
+namespace {
+std::uint64_t field(std::size_t value, int bits, int shift) {
+  const auto mask = (std::uint64_t(1) << bits) - 1;
+  return (std::uint64_t(value) & mask) << shift;
+}
+
+std::size_t extract(std::uint64_t key, int bits, int shift) {
+  return (key >> shift) & ((std::uint64_t(1) << bits) - 1);
+}
+} // namespace
+
+std::uint64_t RenderKey::make(std::size_t pass, std::size_t program,
+                              std::size_t texture, std::size_t normal,
+                              std::size_t model, std::size_t lod,
+                              float depth) {
+  // The bit pattern of a non-negative float sorts like the float itself
+  std::uint32_t depth_bits;
+  depth = std::max(depth, 0.0f);
+  std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+  return field(pass, PASS_BITS, PASS_SHIFT) |
+         field(program, PROGRAM_BITS, PROGRAM_SHIFT) |
+         field(texture, TEXTURE_BITS, TEXTURE_SHIFT) |
+         field(normal, NORMAL_BITS, NORMAL_SHIFT) |
+         field(model, MODEL_BITS, MODEL_SHIFT) |
+         field(lod, LOD_BITS, LOD_SHIFT) | depth_bits;
+}
+
+std::uint64_t RenderKey::state(std::uint64_t key) { return key >> DEPTH_BITS; }
+
+std::size_t RenderKey::pass(std::uint64_t key) {
+  return extract(key, PASS_BITS, PASS_SHIFT);
+}
+
+std::size_t RenderKey::program(std::uint64_t key) {
+  return extract(key, PROGRAM_BITS, PROGRAM_SHIFT);
+}
+
+std::size_t RenderKey::texture(std::uint64_t key) {
+  return extract(key, TEXTURE_BITS, TEXTURE_SHIFT);
+}
+
+std::size_t RenderKey::normal(std::uint64_t key) {
+  return extract(key, NORMAL_BITS, NORMAL_SHIFT);
+}
+
+std::size_t RenderKey::model(std::uint64_t key) {
+  return extract(key, MODEL_BITS, MODEL_SHIFT);
+}
+
+std::size_t RenderKey::lod(std::uint64_t key) {
+  return extract(key, LOD_BITS, LOD_SHIFT);
+}
+
+void RenderQueue::push(std::uint64_t key, const Instance &instance) {
+  packets.push_back({key, static_cast<std::uint32_t>(instances.size())});
+  instances.push_back(instance);
+}
+
+// LSD radix sort, one byte per pass. Passes where every key has the same
+// byte are skipped, which is most of the state bits in a typical frame.
+void RenderQueue::sort() {
+  scratch.resize(packets.size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    std::array<std::size_t, 256> counts = {};
+    for (const auto &packet : packets)
+      counts[(packet.key >> shift) & 0xff]++;
+    if (std::find(counts.begin(), counts.end(), packets.size()) !=
+        counts.end())
+      continue;
+
+    std::size_t offset = 0;
+    for (auto &count : counts) {
+      const auto c = count;
+      count = offset;
+      offset += c;
+    }
+    for (const auto &packet : packets)
+      scratch[counts[(packet.key >> shift) & 0xff]++] = packet;
+    packets.swap(scratch);
+  }
+}
+
+void RenderQueue::clear() {
+  packets.clear();
+  instances.clear();
+}
@@ -0,0 +1,39 @@
+#include "row_index.hpp"
+
+#include "ecs/entities.hpp"
+
+#include <algorithm>
+#include <vector>
+
+void RowIndex::insert(ecs::entities::EntityId id, int row_lo, int row_hi) {
+  if (spans.count(id))
+    remove(id);
+  spans[id] = {row_lo, row_hi};
+  version++;
+  for (int row = row_lo; row <= row_hi; row++)
+    rows[row].push_back(id);
+}
+
+void RowIndex::remove(ecs::entities::EntityId id) {
+  if (!spans.count(id))
+    return;
+  const auto span = spans[id];
+  for (int row = span.first; row <= span.second; row++) {
+    auto &ids = rows[row];
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+  }
+  spans.erase(id);
+  version++;
+}
+
+std::vector<ecs::entities::EntityId> RowIndex::query(int row_lo,
+                                                     int row_hi) const {
+  std::vector<ecs::entities::EntityId> result;
+  for (auto it = rows.lower_bound(row_lo);
+       it != rows.end() && it->first <= row_hi; it++)
+    result.insert(result.end(), it->second.begin(), it->second.end());
+  // Entities spanning several rows are listed once per row
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
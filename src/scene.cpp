@@ -6,11 +6,14 @@
 
 #include <glm/ext/matrix_transform.hpp>
 
+#include <algorithm>
 #include <cstddef>
 
 #include "bounding_box.hpp"
 #include "components.hpp"
+#include "frustum.hpp"
 #include "grid.hpp"
+#include "lane.hpp"
 #include "registry.hpp"
 
 void setup_camera(ecs::Context<Registry> &ctx, int col) {
@@ -33,19 +36,13 @@ void setup_camera(ecs::Context<Registry> &ctx, int col) {
 
 void create_character(ecs::Context<Registry> &ctx, int col) {
   const auto character_pos = grid_to_world(0, col, 0, col).midpoint()[0];
-  const auto model_index = ctx.registry().model_indices["rooster.obj"];
-  const auto texture_index =
-      ctx.registry().texture_indicies["rooster_texture.jpg"];
-  const auto normal_index = ctx.registry().texture_indicies["empty_normal.png"];
+  const auto &assets = ctx.registry().scene_assets;
   const auto id = ctx.registry().add_mesh(
-      ctx, {
-               model_index,
-               texture_index,
-               normal_index,
-               glm::translate(glm::mat4(1), glm::vec3(character_pos, 0, 0)),
-           });
+      ctx, {assets.rooster, assets.rooster_texture, assets.empty_normal},
+      glm::translate(glm::mat4(1), glm::vec3(character_pos, 0, 0)));
   ctx.registry().camera_init = glm::vec3(character_pos, 0, 0);
   ctx.registry().character_id = id;
+  ctx.registry().player_col = col;
   ctx.registry().animations[id] = {
       components::AnimationState::BEFORE_START,
       {
@@ -57,110 +54,139 @@ void create_character(ecs::Context<Registry> &ctx, int col) {
   };
   auto &character = ctx.registry().characters[id];
   auto &mesh = ctx.registry().meshes[id];
-  character.model_bb = ctx.registry().models[model_index].bounding_box;
+  character.model_bb = ctx.registry().models[mesh.model_index].bounding_box;
+}
+
+void add_static(ecs::Context<Registry> &ctx, ecs::entities::EntityId id,
+                int row_index) {
+  const auto &mesh = ctx.registry().meshes[id];
+  ctx.registry().static_batcher.add(
+      id, row_index,
+      transform_bounds(
+          ctx.registry().models[mesh.model_index].bounding_box, mesh.mat));
+}
+
+void build_static_chunks(ecs::Context<Registry> &ctx, bool all) {
+  auto &registry = ctx.registry();
+  for (auto &entry : registry.static_batcher.chunks) {
+    // Later rows of a chunk may still be generated
+    if (!all && (entry.first + 1) * MAP_CHUNK_ROWS >
+                    static_cast<int>(registry.map_top_generated))
+      continue;
+    registry.static_batcher.build(entry.first, registry.meshes,
+                                  registry.models, registry.mesh_pool);
+  }
 }
 
 void fill_map_row(ecs::Context<Registry> &ctx, int row_index,
                   TileType tile_type) {
+  const auto &assets = ctx.registry().scene_assets;
   float delta_y = 0.0;
-  std::size_t texture_index =
-      ctx.registry().texture_indicies["ground_texture.jpg"];
-  std::size_t normal_index =
-      ctx.registry().texture_indicies["ground_normal.jpg"];
+  auto texture = assets.ground_texture, normal = assets.ground_normal;
   if (tile_type == TileType::ROAD) {
     delta_y -= ROAD_OFFSET;
-    texture_index = ctx.registry().texture_indicies["road_texture.jpg"];
-    normal_index = ctx.registry().texture_indicies["road_normal.png"];
+    texture = assets.road_texture;
+    normal = assets.road_normal;
   }
-  ctx.registry().add_mesh(
-      ctx,
-      {ctx.registry().model_indices["floor2.obj"], texture_index, normal_index,
-       glm::translate(glm::mat4(1),
-                      glm::vec3(0, delta_y, (int)row_index * -STEP_SIZE))});
+  const auto offset = glm::vec3(0, delta_y, (int)row_index * -STEP_SIZE);
+  const auto id = ctx.registry().add_mesh(
+      ctx, {assets.floor, texture, normal},
+      glm::translate(glm::mat4(1), offset));
+  add_static(ctx, id, row_index);
+}
+
+void add_action_restriction(ecs::Context<Registry> &ctx, int row1, int col1,
+                            int row2, int col2, components::ActionKind action,
+                            bool ignore_passthrough) {
+  const auto restriction_id = ctx.entity_manager().next_id();
+  ctx.registry().action_restrictions[restriction_id] = {
+      grid_to_world(row1, col1, row2, col2), {action}, ignore_passthrough};
+  ctx.registry().map_rows.insert(restriction_id, std::min(row1, row2),
+                                 std::max(row1, row2));
+  ctx.registry().triggers.insert(restriction_id, row1, col1, row2, col2);
 }
 
 void create_tree(ecs::Context<Registry> &ctx, std::size_t row_index,
                  std::size_t col_index) {
   const auto tree_pos =
       grid_to_world(row_index, col_index, row_index, col_index).midpoint();
-  const auto texture_index =
-      ctx.registry().texture_indicies["tree_texture.png"];
-  const auto normal_index = ctx.registry().texture_indicies["empty_normal.png"];
+  const auto &assets = ctx.registry().scene_assets;
   const auto id = ctx.registry().add_mesh(
-      ctx,
-      {ctx.registry().model_indices["tree.obj"], texture_index, normal_index,
-       glm::translate(glm::mat4(1), glm::vec3(tree_pos[0], 0, tree_pos[2]))});
-
-  const std::vector<std::pair<BoundingBox3D, components::ActionKind>>
-      adjacent_pos = {
-          {grid_to_world(row_index, col_index - 1, row_index, col_index - 1),
-           components::ActionKind::MOVE_RIGHT},
-          {grid_to_world(row_index, col_index + 1, row_index, col_index + 1),
-           components::ActionKind::MOVE_LEFT},
-          {grid_to_world(row_index + 1, col_index, row_index + 1, col_index),
-           components::ActionKind::MOVE_BACK},
-          {grid_to_world(row_index - 1, col_index, row_index - 1, col_index),
-           components::ActionKind::MOVE_FORWARD},
-      };
-  for (const auto &p : adjacent_pos) {
-    const auto restriction_id = ctx.entity_manager().next_id();
-    const auto &bb = p.first;
-    const auto &action = p.second;
-    ctx.registry().action_restrictions[restriction_id] = {bb, {action}, false};
-  }
+      ctx, {assets.tree, assets.tree_texture, assets.empty_normal},
+      glm::translate(glm::mat4(1), glm::vec3(tree_pos[0], 0, tree_pos[2])));
+  add_static(ctx, id, row_index);
+
+  const int row = row_index, col = col_index;
+  add_action_restriction(ctx, row, col - 1, row, col - 1,
+                         components::ActionKind::MOVE_RIGHT, false);
+  add_action_restriction(ctx, row, col + 1, row, col + 1,
+                         components::ActionKind::MOVE_LEFT, false);
+  add_action_restriction(ctx, row + 1, col, row + 1, col,
+                         components::ActionKind::MOVE_BACK, false);
+  add_action_restriction(ctx, row - 1, col, row - 1, col,
+                         components::ActionKind::MOVE_FORWARD, false);
+}
+
+void add_to_lane(ecs::Context<Registry> &ctx, ecs::entities::EntityId id,
+                 const float pos_x, const std::size_t row_index,
+                 const float vel) {
+  auto &lanes = ctx.registry().lanes;
+  if (!lanes.count(row_index))
+    lanes[row_index] = Lane(vel);
+  auto &lane = lanes[row_index];
+  const auto &mesh = ctx.registry().meshes[id];
+  const auto &model_bb = ctx.registry().models[mesh.model_index].bounding_box;
+  const auto car_bb = model_bb.transform(mesh.mat);
+  const auto phase =
+      lane.add(id, pos_x, car_bb.min_point[0], car_bb.max_point[0]);
+  ctx.registry().cars[id] = {row_index, phase, model_bb};
+  ctx.registry().map_rows.insert(id, row_index, row_index);
 }
 
 void create_car(ecs::Context<Registry> &ctx, const float pos_x,
                 const std::size_t row_index, const float vel) {
   const float actual_pos_z = -STEP_SIZE * row_index;
-  auto translate_mat = glm::translate(
-      glm::mat4(1), glm::vec3(pos_x, -ROAD_OFFSET, actual_pos_z));
+  auto translate_mat =
+      glm::translate(glm::mat4(1), glm::vec3(0, -ROAD_OFFSET, actual_pos_z));
   if (vel <= 0.0f)
     translate_mat =
-        glm::scale(glm::mat4(1), glm::vec3(-1.0f, 1.0f, 1.0f)) * translate_mat;
-  const auto model_index = ctx.registry().model_indices["car.obj"];
-  const auto texture_index = ctx.registry().texture_indicies["car_texture.png"];
-  const auto normal_index = ctx.registry().texture_indicies["empty_normal.png"];
+        translate_mat * glm::scale(glm::mat4(1), glm::vec3(-1.0f, 1.0f, 1.0f));
+  const auto &assets = ctx.registry().scene_assets;
   const auto id = ctx.registry().add_mesh(
-      ctx, {model_index, texture_index, normal_index, translate_mat});
-  const auto &mesh = ctx.registry().meshes[id];
-  ctx.registry().cars[id] = {glm::vec3(vel, 0.0, 0.0),
-                             ctx.registry().models[model_index].bounding_box};
+      ctx, {assets.car, assets.car_texture, assets.empty_normal},
+      translate_mat);
+  add_to_lane(ctx, id, pos_x, row_index, vel);
 }
 
 void create_truck(ecs::Context<Registry> &ctx, const float pos_x,
                   const std::size_t row_index, const float vel) {
   const float actual_pos_z = -STEP_SIZE * row_index;
-  auto translate_mat = glm::translate(
-      glm::mat4(1), glm::vec3(pos_x, -ROAD_OFFSET, actual_pos_z));
+  auto translate_mat =
+      glm::translate(glm::mat4(1), glm::vec3(0, -ROAD_OFFSET, actual_pos_z));
   if (vel <= 0.0f)
     translate_mat =
-        glm::scale(glm::mat4(1), glm::vec3(-1.0f, 1.0f, 1.0f)) * translate_mat;
-  const auto model_index = ctx.registry().model_indices["truck.obj"];
-  const auto texture_index =
-      ctx.registry().texture_indicies["truck_texture.jpg"];
-  const auto normal_index = ctx.registry().texture_indicies["empty_normal.png"];
+        translate_mat * glm::scale(glm::mat4(1), glm::vec3(-1.0f, 1.0f, 1.0f));
+  const auto &assets = ctx.registry().scene_assets;
   const auto id = ctx.registry().add_mesh(
-      ctx, {model_index, texture_index, normal_index, translate_mat});
-  ctx.registry().cars[id] = {glm::vec3(vel, 0.0, 0.0)};
-  const auto &mesh = ctx.registry().meshes[id];
-  ctx.registry().cars[id] = {glm::vec3(vel, 0.0, 0.0),
-                             ctx.registry().models[model_index].bounding_box};
+      ctx, {assets.truck, assets.truck_texture, assets.empty_normal},
+      translate_mat);
+  add_to_lane(ctx, id, pos_x, row_index, vel);
 }
 
 void create_shoe_item(ecs::Context<Registry> &ctx, std::size_t row_index,
                       std::size_t col_index) {
   const auto position = glm::vec3(col_index * STEP_SIZE - 3.5f * STEP_SIZE,
                                   SHOE_OFFSET, -STEP_SIZE * row_index);
-  const auto model_index = ctx.registry().model_indices["sneakers.obj"];
-  const auto texture_index =
-      ctx.registry().texture_indicies["empty_texture.png"];
-  const auto normal_index = ctx.registry().texture_indicies["empty_normal.png"];
-  const auto shoe_id =
-      ctx.registry().add_mesh(ctx, {model_index, texture_index, normal_index,
-                                    glm::translate(glm::mat4(1), position)});
+  const auto &assets = ctx.registry().scene_assets;
+  const auto shoe_id = ctx.registry().add_mesh(
+      ctx, {assets.sneakers, assets.empty_texture, assets.empty_normal},
+      glm::translate(glm::mat4(1), position));
+  const auto &mesh = ctx.registry().meshes[shoe_id];
   ctx.registry().shoe_items[shoe_id] = {
-      ctx.registry().models[model_index].bounding_box};
+      ctx.registry().models[mesh.model_index].bounding_box};
+  ctx.registry().map_rows.insert(shoe_id, row_index, row_index);
+  ctx.registry().triggers.insert(shoe_id, row_index, col_index, row_index,
+                                 col_index);
 }
 
 bool check_map_valid(std::vector<std::vector<bool>> check) {
@@ -243,8 +269,8 @@ void create_map(ecs::Context<Registry> &ctx) {
     auto vel = ctx.registry().random_speed(ctx);
     // Generate car with 40% density
     // 70% car, 30% truck
-    for (double j = (-2.5 * GRID_SIZE) * STEP_SIZE; j <= (1.5 * GRID_SIZE);
-         j += 3.0) {
+    // Spawn over exactly one lane length so that wrapped cars never coincide
+    for (float j = LANE_MIN_X; j < LANE_MIN_X + LANE_LENGTH; j += 3.0f) {
       if (ctx.registry().random_probability(ctx, CAR_SPAWN_DENSITY)) {
         if (ctx.registry().random_probability(ctx, TRUCK_RATE))
           create_truck(ctx, j, ctx.registry().map_top_generated + i, vel);
@@ -257,23 +283,16 @@ void create_map(ecs::Context<Registry> &ctx) {
   ctx.registry().map_top_generated += road_length;
 
   // Set map bound
-  const std::vector<std::pair<BoundingBox3D, components::ActionKind>>
-      adjacent_pos = {
-          {grid_to_world(
-               ctx.registry().map_top_generated - grass_length - road_length,
-               GRID_SIZE - 1, ctx.registry().map_top_generated, GRID_SIZE - 1),
-           components::ActionKind::MOVE_RIGHT},
-          {grid_to_world(ctx.registry().map_top_generated - grass_length -
-                             road_length,
-                         0, ctx.registry().map_top_generated, 0),
-           components::ActionKind::MOVE_LEFT},
-      };
-  for (const auto &p : adjacent_pos) {
-    const auto restriction_id = ctx.entity_manager().next_id();
-    const auto &bb = p.first;
-    const auto &action = p.second;
-    ctx.registry().action_restrictions[restriction_id] = {bb, {action}, true};
-  }
+  const int chunk_bottom =
+                ctx.registry().map_top_generated - grass_length - road_length,
+            chunk_top = ctx.registry().map_top_generated;
+  add_action_restriction(ctx, chunk_bottom, GRID_SIZE - 1, chunk_top,
+                         GRID_SIZE - 1, components::ActionKind::MOVE_RIGHT,
+                         true);
+  add_action_restriction(ctx, chunk_bottom, 0, chunk_top, 0,
+                         components::ActionKind::MOVE_LEFT, true);
+
+  build_static_chunks(ctx, false);
 }
 
 void create_map_init(ecs::Context<Registry> &ctx) {
@@ -288,20 +307,14 @@ void create_map_init(ecs::Context<Registry> &ctx) {
   // Set camera
   setup_camera(ctx, start_col);
 
-  const std::vector<std::pair<BoundingBox3D, components::ActionKind>>
-      adjacent_pos = {
-          {grid_to_world(0, GRID_SIZE - 1, 0, GRID_SIZE - 1),
-           components::ActionKind::MOVE_RIGHT},
-          {grid_to_world(0, 0, 0, 0), components::ActionKind::MOVE_LEFT},
-          {grid_to_world(0, 0, 0, GRID_SIZE - 1),
-           components::ActionKind::MOVE_BACK},
-      };
-  for (const auto &p : adjacent_pos) {
-    const auto restriction_id = ctx.entity_manager().next_id();
-    const auto &bb = p.first;
-    const auto &action = p.second;
-    ctx.registry().action_restrictions[restriction_id] = {bb, {action}, true};
-  }
+  add_action_restriction(ctx, 0, GRID_SIZE - 1, 0, GRID_SIZE - 1,
+                         components::ActionKind::MOVE_RIGHT, true);
+  add_action_restriction(ctx, 0, 0, 0, 0, components::ActionKind::MOVE_LEFT,
+                         true);
+  add_action_restriction(ctx, 0, 0, 0, GRID_SIZE - 1,
+                         components::ActionKind::MOVE_BACK, true);
+
+  build_static_chunks(ctx, false);
 }
 
 void create_map_finish(ecs::Context<Registry> &ctx) {
@@ -311,4 +324,10 @@ void create_map_finish(ecs::Context<Registry> &ctx) {
   const auto win_zone_id = ctx.entity_manager().next_id();
   ctx.registry().win_zones[win_zone_id] = {
       grid_to_world(top, 0, top, GRID_SIZE - 1)};
+  ctx.registry().map_rows.insert(win_zone_id, top, top);
+  ctx.registry().triggers.insert(win_zone_id, top, 0, top, GRID_SIZE - 1);
+
+  // Nothing is generated past the finish, so partial chunks are final too
+  ctx.registry().map_top_generated += 32;
+  build_static_chunks(ctx, true);
 }
@@ -0,0 +1,189 @@
+#include "shader_cache.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "file_util.hpp"
+#include "shader_program.hpp"
+
+namespace {
+std::string read_source(const std::string &filename) {
+  std::string source;
+  if (!read_file(filename, source))
+    throw std::runtime_error("shader file read failed: " + filename);
+  return source;
+}
+
+std::string gl_string(GLenum name) {
+  const auto value = glGetString(name);
+  return value == nullptr ? "" : reinterpret_cast<const char *>(value);
+}
+
+bool compiled(GLuint shader_id) {
+  GLint status;
+  glGetShaderiv(shader_id, GL_COMPILE_STATUS, &status);
+  return status == GL_TRUE;
+}
+} // namespace
+
+ShaderCache::ShaderCache(const std::string &directory)
+    : directory(directory), driver(gl_string(GL_VENDOR) + "\n" +
+                                   gl_string(GL_RENDERER) + "\n" +
+                                   gl_string(GL_VERSION)) {
+#ifdef __APPLE__
+  binaries_supported = true;
+#else
+  binaries_supported = GLEW_ARB_get_program_binary;
+  // Let the driver compile on as many threads as it wants
+  if (GLEW_KHR_parallel_shader_compile)
+    glMaxShaderCompilerThreadsKHR(0xffffffff);
+#endif
+  if (binaries_supported) {
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    binaries_supported = format_count > 0;
+  }
+  if (binaries_supported)
+    make_directory(directory);
+}
+
+std::size_t ShaderCache::request(const std::string &vertex_shader_filename,
+                                 const std::string &fragment_shader_filename,
+                                 const std::vector<std::string> &defines) {
+  Pending program;
+  program.vertex_shader_filename = vertex_shader_filename;
+  program.fragment_shader_filename = fragment_shader_filename;
+  // Variants differ in their sources, so they get keys of their own
+  program.vertex_source =
+      inject_defines(read_source(vertex_shader_filename), defines);
+  program.fragment_source =
+      inject_defines(read_source(fragment_shader_filename), defines);
+  program.key = hash(hash(hash(FNV_OFFSET_BASIS, driver),
+                          program.vertex_source),
+                     program.fragment_source);
+  program.program_id = glCreateProgram();
+  program.vertex_shader_id = 0;
+  program.fragment_shader_id = 0;
+  program.from_binary = binaries_supported && load_binary(program);
+  // Statuses are only queried in finish(), so these can run in the
+  // background
+  if (!program.from_binary) {
+    compile(program);
+    link(program);
+  }
+  pending.push_back(std::move(program));
+  return pending.size() - 1;
+}
+
+std::vector<ShaderProgram> ShaderCache::finish() {
+  std::vector<ShaderProgram> programs;
+  for (auto &program : pending) {
+    GLint link_status;
+    glGetProgramiv(program.program_id, GL_LINK_STATUS, &link_status);
+    if (link_status == GL_FALSE && program.from_binary) {
+      // The driver rejected a stale binary; build from source instead
+      program.from_binary = false;
+      compile(program);
+      link(program);
+      glGetProgramiv(program.program_id, GL_LINK_STATUS, &link_status);
+    }
+    if (link_status == GL_FALSE) {
+      if (!compiled(program.vertex_shader_id))
+        throw std::runtime_error("shader compilation failed: " +
+                                 program.vertex_shader_filename);
+      if (!compiled(program.fragment_shader_id))
+        throw std::runtime_error("shader compilation failed: " +
+                                 program.fragment_shader_filename);
+      throw std::runtime_error("shader link failed: " +
+                               program.vertex_shader_filename + ", " +
+                               program.fragment_shader_filename);
+    }
+
+    if (!program.from_binary) {
+      glDeleteShader(program.vertex_shader_id);
+      glDeleteShader(program.fragment_shader_id);
+      if (binaries_supported)
+        save_binary(program);
+    }
+    programs.emplace_back(program.program_id);
+  }
+  pending.clear();
+  return programs;
+}
+
+std::string ShaderCache::path(std::uint64_t key) const {
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx",
+                static_cast<unsigned long long>(key));
+  return directory + "/" + name + ".bin";
+}
+
+bool ShaderCache::load_binary(Pending &program) const {
+  std::ifstream infile(path(program.key), std::ios::binary);
+  if (!infile)
+    return false;
+  const std::vector<char> data((std::istreambuf_iterator<char>(infile)),
+                               std::istreambuf_iterator<char>());
+  GLenum format;
+  if (data.size() <= sizeof(format))
+    return false;
+  std::memcpy(&format, data.data(), sizeof(format));
+  glProgramBinary(program.program_id, format, data.data() + sizeof(format),
+                  data.size() - sizeof(format));
+  return true;
+}
+
+// A file cut short by a crash only fails to load and gets rewritten
+void ShaderCache::save_binary(const Pending &program) const {
+  GLint length = 0;
+  glGetProgramiv(program.program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+  std::vector<char> data(sizeof(GLenum) + length);
+  GLenum format;
+  glGetProgramBinary(program.program_id, length, nullptr, &format,
+                     data.data() + sizeof(format));
+  std::memcpy(data.data(), &format, sizeof(format));
+  std::ofstream outfile(path(program.key), std::ios::binary);
+  outfile.write(data.data(), data.size());
+}
+
+void ShaderCache::compile(Pending &program) const {
+  const auto compile_shader = [](GLenum type, const std::string &source) {
+    const auto shader_id = glCreateShader(type);
+    const char *raw_source = source.c_str();
+    glShaderSource(shader_id, 1, &raw_source, nullptr);
+    glCompileShader(shader_id);
+    return shader_id;
+  };
+  program.vertex_shader_id =
+      compile_shader(GL_VERTEX_SHADER, program.vertex_source);
+  program.fragment_shader_id =
+      compile_shader(GL_FRAGMENT_SHADER, program.fragment_source);
+}
+
+void ShaderCache::link(Pending &program) const {
+  glAttachShader(program.program_id, program.vertex_shader_id);
+  glAttachShader(program.program_id, program.fragment_shader_id);
+  if (binaries_supported)
+    glProgramParameteri(program.program_id,
+                        GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(program.program_id);
+}
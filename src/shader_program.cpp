@@ -10,10 +10,43 @@
 #include <GL/glut.h>
 #endif
 
+#include <glm/glm.hpp>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+std::vector<std::string> feature_defines(unsigned int features) {
+  std::vector<std::string> defines;
+  if (features & NORMAL_MAP_FEATURE)
+    defines.push_back("NORMAL_MAP");
+  if (features & DIFFUSE_LIGHTING_FEATURE)
+    defines.push_back("DIFFUSE_LIGHTING");
+  if (features & POINT_LIGHTS_FEATURE)
+    defines.push_back("POINT_LIGHTS");
+  return defines;
+}
+
+std::string inject_defines(const std::string &source,
+                           const std::vector<std::string> &defines) {
+  std::string block;
+  for (const auto &define : defines)
+    block += "#define " + define + " 1\n";
+  // #version has to stay the first statement
+  auto line_end = std::string::npos;
+  if (source.compare(0, 8, "#version") == 0)
+    line_end = source.find('\n');
+  if (line_end == std::string::npos)
+    return block + source;
+  return source.substr(0, line_end + 1) + block + source.substr(line_end + 1);
+}
 
 void load_shader(GLuint shader_id, const std::string &filename) {
   std::ifstream infile(filename);
@@ -44,4 +77,109 @@ ShaderProgram::ShaderProgram(const std::string &vertex_shader_filename,
   glLinkProgram(program_id);
   glDeleteShader(vertex_shader_id);
   glDeleteShader(fragment_shader_id);
+
+  reflect();
+}
+
+ShaderProgram::ShaderProgram(GLuint program_id) : program_id(program_id) {
+  reflect();
+}
+
+void ShaderProgram::reflect() {
+  const auto query = [this](GLenum count_param, GLenum length_param,
+                            bool uniform) {
+    GLint count, max_length;
+    glGetProgramiv(program_id, count_param, &count);
+    glGetProgramiv(program_id, length_param, &max_length);
+    std::vector<GLchar> buffer(std::max(max_length, 1));
+    std::vector<ShaderVariable> variables;
+    for (GLint i = 0; i < count; i++) {
+      GLsizei length;
+      GLint size;
+      GLenum type;
+      if (uniform)
+        glGetActiveUniform(program_id, i, buffer.size(), &length, &size,
+                           &type, buffer.data());
+      else
+        glGetActiveAttrib(program_id, i, buffer.size(), &length, &size, &type,
+                          buffer.data());
+      std::string name(buffer.data(), length);
+      // Array uniforms are reported as "name[0]"
+      const auto bracket = name.find('[');
+      if (bracket != std::string::npos)
+        name.erase(bracket);
+      const auto location =
+          uniform ? glGetUniformLocation(program_id, name.c_str())
+                  : glGetAttribLocation(program_id, name.c_str());
+      // Uniforms inside blocks have no location of their own
+      if (location < 0)
+        continue;
+      variables.push_back({name, location, type, size});
+    }
+    std::sort(variables.begin(), variables.end(),
+              [](const ShaderVariable &a, const ShaderVariable &b) {
+                return a.name < b.name;
+              });
+    return variables;
+  };
+
+  uniforms = query(GL_ACTIVE_UNIFORMS, GL_ACTIVE_UNIFORM_MAX_LENGTH, true);
+  attributes =
+      query(GL_ACTIVE_ATTRIBUTES, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, false);
+  uniform_values.assign(uniforms.size(), {});
+  uniform_valid.assign(uniforms.size(), false);
+}
+
+GLint ShaderProgram::attribute_location(const std::string &name) const {
+  const auto it = std::lower_bound(
+      attributes.begin(), attributes.end(), name,
+      [](const ShaderVariable &v, const std::string &n) { return v.name < n; });
+  if (it == attributes.end() || it->name != name)
+    return -1;
+  return it->location;
+}
+
+void ShaderProgram::bind_uniform_block(const std::string &name,
+                                       GLuint binding) const {
+  const auto block_index = glGetUniformBlockIndex(program_id, name.c_str());
+  if (block_index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program_id, block_index, binding);
+}
+
+bool ShaderProgram::update_cache(std::size_t index, const void *value,
+                                 std::size_t size) {
+  if (index >= uniforms.size())
+    return false;
+  auto &cached = uniform_values[index];
+  if (uniform_valid[index] && std::memcmp(cached.data(), value, size) == 0)
+    return false;
+  std::memcpy(cached.data(), value, size);
+  uniform_valid[index] = true;
+  return true;
+}
+
+void ShaderProgram::set(const Uniform<float> &uniform, float value) {
+  if (update_cache(uniform.index, &value, sizeof(value)))
+    glUniform1f(uniform.location, value);
+}
+
+void ShaderProgram::set(const Uniform<int> &uniform, int value) {
+  if (update_cache(uniform.index, &value, sizeof(value)))
+    glUniform1i(uniform.location, value);
+}
+
+void ShaderProgram::set(const Uniform<bool> &uniform, bool value) {
+  set(Uniform<int>{uniform.index, uniform.location}, (int)value);
+}
+
+void ShaderProgram::set(const Uniform<glm::vec3> &uniform,
+                        const glm::vec3 &value) {
+  if (update_cache(uniform.index, glm::value_ptr(value), sizeof(value)))
+    glUniform3fv(uniform.location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::set(const Uniform<glm::mat4> &uniform,
+                        const glm::mat4 &value) {
+  if (update_cache(uniform.index, glm::value_ptr(value), sizeof(value)))
+    glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
 }
@@ -0,0 +1,134 @@
+#include "static_batcher.hpp"
+
+#include "ecs/entities.hpp"
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bounding_box.hpp"
+#include "components.hpp"
+#include "grid.hpp"
+#include "mesh_pool.hpp"
+#include "model.hpp"
+#include "vertex_format.hpp"
+
+void StaticBatcher::add(ecs::entities::EntityId id, int row,
+                        const BoundingBox3D &bounds) {
+  auto &chunk = chunks[row_chunk(row)];
+  chunk.bounds = chunk.ids.empty() ? bounds : chunk.bounds.merge(bounds);
+  chunk.ids.push_back(id);
+  version++;
+}
+
+void StaticBatcher::build(
+    int chunk_index,
+    const std::unordered_map<ecs::entities::EntityId, components::Mesh>
+        &meshes,
+    const std::vector<Model> &models, const MeshPool &pool) {
+  auto &chunk = chunks.at(chunk_index);
+  if (chunk.built)
+    return;
+
+  struct Geometry {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+  };
+  std::map<std::pair<std::size_t, std::size_t>, Geometry> geometries;
+  std::unordered_map<GLuint, GLuint> remap;
+  for (const auto id : chunk.ids) {
+    const auto &mesh = meshes.at(id);
+    const auto &range = models[mesh.model_index].lods.front();
+    const auto normal_mat = glm::transpose(glm::inverse(glm::mat3(mesh.mat)));
+    auto &geometry = geometries[{mesh.texture_index, mesh.normal_index}];
+    remap.clear();
+    for (GLuint i = 0; i < range.index_count; i++) {
+      const GLuint vertex =
+          range.base_vertex + pool.indices[range.first_index + i];
+      auto it = remap.find(vertex);
+      if (it == remap.end()) {
+        it = remap.emplace(vertex, geometry.vertices.size()).first;
+        auto target = pool.vertices[vertex];
+        target.pos = glm::vec3(mesh.mat * glm::vec4(target.pos, 1));
+        target.normal = normal_mat * target.normal;
+        target.tangent =
+            glm::vec4(normal_mat * glm::vec3(target.tangent), target.tangent.w);
+        geometry.vertices.push_back(target);
+      }
+      geometry.indices.push_back(it->second);
+    }
+  }
+
+  std::vector<MeshVertex> vertices;
+  std::vector<GLuint> indices;
+  for (const auto &entry : geometries) {
+    StaticBatch batch;
+    batch.texture_index = entry.first.first;
+    batch.normal_index = entry.first.second;
+    batch.range.first_index = indices.size();
+    batch.range.index_count = entry.second.indices.size();
+    batch.range.base_vertex = vertices.size();
+    vertices.insert(vertices.end(), entry.second.vertices.begin(),
+                    entry.second.vertices.end());
+    indices.insert(indices.end(), entry.second.indices.begin(),
+                   entry.second.indices.end());
+    chunk.batches.push_back(batch);
+  }
+
+  std::vector<Instance> instances;
+  for (const auto &batch : chunk.batches)
+    instances.push_back({glm::mat4(1), static_cast<GLuint>(batch.texture_index),
+                         static_cast<GLuint>(batch.normal_index)});
+  glGenBuffers(1, &chunk.instance_buffer_id);
+  glBindBuffer(GL_ARRAY_BUFFER, chunk.instance_buffer_id);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * instances.size(),
+               instances.data(), GL_STATIC_DRAW);
+
+  glGenVertexArrays(1, &chunk.vao_id);
+  glBindVertexArray(chunk.vao_id);
+  glGenBuffers(1, &chunk.vertex_buffer_id);
+  glBindBuffer(GL_ARRAY_BUFFER, chunk.vertex_buffer_id);
+  // Chunks sit in world space, too far out for half float positions
+  const auto packed = pack_vertices(vertices, PositionFormat::FLOAT);
+  glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+  glGenBuffers(1, &chunk.index_buffer_id);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.index_buffer_id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(),
+               indices.data(), GL_STATIC_DRAW);
+  bind_vertex_layout(PositionFormat::FLOAT);
+  MeshPool::bind_instance_layout(chunk.instance_buffer_id, 0);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  chunk.built = true;
+  version++;
+}
+
+void StaticBatcher::unload(int chunk_index) {
+  auto it = chunks.find(chunk_index);
+  if (it == chunks.end())
+    return;
+  auto &chunk = it->second;
+  if (chunk.built) {
+    glDeleteVertexArrays(1, &chunk.vao_id);
+    glDeleteBuffers(1, &chunk.vertex_buffer_id);
+    glDeleteBuffers(1, &chunk.index_buffer_id);
+    glDeleteBuffers(1, &chunk.instance_buffer_id);
+  }
+  chunks.erase(it);
+  version++;
+}
@@ -19,17 +19,106 @@
 #include <GL/glut.h>
 #endif
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
 
 #include "components.hpp"
+#include "frame_ring.hpp"
+#include "frame_uniforms.hpp"
+#include "frustum.hpp"
 #include "grid.hpp"
+#include "lane.hpp"
+#include "light_clusters.hpp"
+#include "mesh_lod.hpp"
+#include "mesh_pool.hpp"
+#include "profiler.hpp"
 #include "registry.hpp"
+#include "render_queue.hpp"
 #include "scene.hpp"
+#include "shader_program.hpp"
+#include "static_batcher.hpp"
 
 namespace systems {
+Timed::Timed(const std::string &name, ecs::systems::System<Registry> *system)
+    : name(name), system(system) {}
+
+void Timed::update_single(ecs::Context<Registry> &ctx,
+                          ecs::entities::EntityId id) {}
+
+void Timed::operator()(ecs::Context<Registry> &ctx) {
+  const auto start = Profiler::Clock::now();
+  (*system)(ctx);
+  ctx.registry().profiler.record_cpu(
+      name, std::chrono::duration<float, std::milli>(Profiler::Clock::now() -
+                                                     start)
+                .count());
+}
+
+void RegionSystem::update_all(ecs::Context<Registry> &ctx) {
+  const auto &awake_ids = ctx.registry().awake_ids;
+  for (std::size_t i = 0; i < awake_ids.size(); i++)
+    if (should_apply(ctx, awake_ids[i]))
+      update_single(ctx, awake_ids[i]);
+}
+
+void Activity::operator()(ecs::Context<Registry> &ctx) {
+  auto &registry = ctx.registry();
+  const int row = registry.player_row;
+  if (row == registry.activity_row &&
+      registry.map_rows.version == registry.activity_version)
+    return;
+  registry.activity_row = row;
+  registry.activity_version = registry.map_rows.version;
+
+  auto awake_ids = registry.map_rows.query(row - registry.activity_rows_behind,
+                                           row + registry.activity_rows_ahead);
+  collect_subtree(ctx, registry.character_id, awake_ids);
+  std::sort(awake_ids.begin(), awake_ids.end());
+  awake_ids.erase(std::unique(awake_ids.begin(), awake_ids.end()),
+                  awake_ids.end());
+
+  std::vector<ecs::entities::EntityId> slept, woken;
+  std::set_difference(registry.awake_ids.begin(), registry.awake_ids.end(),
+                      awake_ids.begin(), awake_ids.end(),
+                      std::back_inserter(slept));
+  std::set_difference(awake_ids.begin(), awake_ids.end(),
+                      registry.awake_ids.begin(), registry.awake_ids.end(),
+                      std::back_inserter(woken));
+  for (const auto id : slept)
+    registry.sleep_times[id] = registry.sim_time;
+  for (const auto id : woken)
+    wake(ctx, id);
+  registry.awake_ids = std::move(awake_ids);
+}
+
+void Activity::collect_subtree(ecs::Context<Registry> &ctx,
+                               ecs::entities::EntityId id,
+                               std::vector<ecs::entities::EntityId> &ids) {
+  ids.push_back(id);
+  for (const auto child_id : ctx.entity_manager().entity_graph()[id].children)
+    collect_subtree(ctx, child_id, ids);
+}
+
+void Activity::wake(ecs::Context<Registry> &ctx, ecs::entities::EntityId id) {
+  auto &sleep_times = ctx.registry().sleep_times;
+  if (!sleep_times.count(id))
+    return;
+  const float slept = ctx.registry().sim_time - sleep_times[id];
+  sleep_times.erase(id);
+  // Cars are placed from the simulation clock already, so only animations
+  // have state to catch up on.
+  if (ctx.registry().animations.count(id))
+    Animation::fast_forward(ctx, id, slept);
+}
+
 bool Render::should_apply(ecs::Context<Registry> &ctx,
                           ecs::entities::EntityId id) {
   return ctx.registry().meshes.count(id) &&
@@ -37,11 +126,14 @@ bool Render::should_apply(ecs::Context<Registry> &ctx,
 }
 
 void Render::pre_update(ecs::Context<Registry> &ctx) {
-  const auto program_index = ctx.registry().program_index;
-  const auto shader_program = ctx.registry().shader_programs[program_index];
-  glUseProgram(shader_program.program_id);
+  if (program_uniforms.size() != ctx.registry().shader_programs.size())
+    resolve_uniforms(ctx);
+
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  empty_normal_index = ctx.registry().texture_assets.index(
+      ctx.registry().scene_assets.empty_normal);
+  ctx.registry().texture_streamer.update(ctx.registry().texture_arrays);
 
   const auto &character_mesh =
       ctx.registry().meshes[ctx.registry().character_id];
@@ -62,7 +154,9 @@ void Render::pre_update(ecs::Context<Registry> &ctx) {
                                                             -camera_delta[2]});
   else
     lookat_mat = lookat_mat * glm::translate(glm::mat4(1), -camera_delta);
-  set_projection_mat(ctx, camera_mat * lookat_mat);
+  view_mat = lookat_mat;
+  camera_pos = glm::vec3(glm::inverse(lookat_mat)[3]);
+  tan_half_fovy = std::tan(glm::radians(camera_config.fovy) / 2);
 
   auto &light_config = ctx.registry().light_config;
   light_config.light_pos = character_pos + glm::vec3(1.0, 1.0, -2.0);
@@ -71,149 +165,430 @@ void Render::pre_update(ecs::Context<Registry> &ctx) {
                     2 * glm::pi<float>());
   light_config.directional_light =
       glm::vec3(-std::cos(angle), -std::sin(angle), 0.0f);
-  set_light_pos(ctx, light_config.light_pos);
-  set_directional_light(ctx, light_config.directional_light);
-  set_ambient_intensity(ctx, light_config.ambient_intensity);
-  set_diffuse_intensity_point(ctx, light_config.diffuse_intensity_point);
-  set_specular_intensity_point(ctx, light_config.specular_intensity_point);
-  set_diffuse_intensity_directional(ctx,
-                                    light_config.diffuse_intensity_directional);
-  set_specular_intensity_directional(
-      ctx, light_config.specular_intensity_directional);
-  set_diffuse_on(ctx, ctx.registry().diffuse_on);
-  set_normal_mapping_on(ctx, ctx.registry().normal_mapping_on);
-}
 
-void Render::post_update(ecs::Context<Registry> &ctx) { glutSwapBuffers(); }
+  // Everything that is constant over the frame goes out in one buffer update
+  // shared by all programs
+  FrameUniforms frame{};
+  frame.projection_mat = camera_mat * lookat_mat;
+  frame.light_pos = light_config.light_pos;
+  frame.ambient_intensity = light_config.ambient_intensity;
+  frame.directional_light = light_config.directional_light;
+  frame.diffuse_intensity_point = light_config.diffuse_intensity_point;
+  frame.specular_intensity_point = light_config.specular_intensity_point;
+  frame.diffuse_intensity_directional =
+      light_config.diffuse_intensity_directional;
+  frame.specular_intensity_directional =
+      light_config.specular_intensity_directional;
+  frame.znear = camera_config.znear;
+  frame.zfar = camera_config.zfar;
+  frame.cluster_tile_scale =
+      glm::vec2(float(CLUSTER_COUNT_X) / ctx.registry().viewport_width,
+                float(CLUSTER_COUNT_Y) / ctx.registry().viewport_height);
+  frame.cluster_depth_scale =
+      CLUSTER_COUNT_Z / std::log(camera_config.zfar / camera_config.znear);
+  frame.cluster_depth_bias =
+      -std::log(camera_config.znear) * frame.cluster_depth_scale;
+  frame.cluster_count_x = CLUSTER_COUNT_X;
+  frame.cluster_count_y = CLUSTER_COUNT_Y;
+  frame.cluster_count_z = CLUSTER_COUNT_Z;
+  ctx.registry().frame_uniforms.update(&frame);
+  frustum = Frustum(frame.projection_mat);
+
+  // Lights are gathered before any draw is queued, since they decide which
+  // program variant each draw uses
+  point_lights.clear();
+  if (ctx.registry().shader_index == Registry::PHONG_SHADER)
+    for (const auto id : ctx.registry().awake_ids)
+      if (ctx.registry().cars.count(id))
+        add_headlights(ctx, id, Car::transform(ctx, id));
+}
+
+void Render::post_update(ecs::Context<Registry> &ctx) {
+  if (!point_lights.empty()) {
+    const auto &registry = ctx.registry();
+    light_clusters.build(point_lights, view_mat,
+                         registry.camera_config[registry.view_mode]);
+    light_clusters.upload(point_lights);
+    light_clusters.bind();
+  }
+  submit(ctx);
+
+  auto &profiler = ctx.registry().profiler;
+  const auto &stats = ctx.registry().cull_stats;
+  profiler.record_count("chunks_tested", stats.chunks_tested);
+  profiler.record_count("chunks_culled", stats.chunks_culled);
+  profiler.record_count("meshes_tested", stats.meshes_tested);
+  profiler.record_count("meshes_culled", stats.meshes_culled);
+  profiler.record_count("static_batches", stats.static_batches_drawn);
+}
+
+void Render::update_all(ecs::Context<Registry> &ctx) {
+  auto &registry = ctx.registry();
+  if (chunk_version != registry.map_rows.version ||
+      static_version != registry.static_batcher.version)
+    rebuild_chunks(ctx);
+
+  // Only meshes drawn last frame keep their level, so removed ids drop out
+  lod_levels.swap(next_lod_levels);
+  next_lod_levels.clear();
+
+  auto &stats = registry.cull_stats;
+  stats = {};
+  // Besides static geometry, the character is the only mesh kept outside
+  // the row index
+  if (should_apply(ctx, registry.character_id))
+    update_single(ctx, registry.character_id);
+
+  auto previous_visible = false;
+  int previous_chunk = 0;
+  for (const auto &entry : chunk_bounds) {
+    const auto chunk = entry.first;
+    stats.chunks_tested++;
+    const auto visible = frustum.intersect_with(entry.second);
+    if (!visible) {
+      stats.chunks_culled++;
+    } else {
+      const auto static_chunk = registry.static_batcher.chunks.find(chunk);
+      if (static_chunk != registry.static_batcher.chunks.end()) {
+        if (static_chunk->second.built)
+          visible_static.push_back(&static_chunk->second);
+        else
+          for (const auto id : static_chunk->second.ids)
+            if (should_apply(ctx, id))
+              update_single(ctx, id);
+      }
+
+      const auto first_row = chunk * MAP_CHUNK_ROWS;
+      const auto continued = previous_visible && previous_chunk == chunk - 1;
+      for (const auto id : registry.map_rows.query(
+               first_row, first_row + MAP_CHUNK_ROWS - 1)) {
+        // Entities reaching into the previous chunk were drawn with it
+        if (!should_apply(ctx, id) ||
+            (continued && registry.map_rows.spans.at(id).first < first_row))
+          continue;
+        update_single(ctx, id);
+      }
+    }
+    previous_visible = visible;
+    previous_chunk = chunk;
+  }
+}
 
 void Render::update_single(ecs::Context<Registry> &ctx,
                            ecs::entities::EntityId id) {
   const auto &mesh = ctx.registry().meshes.at(id);
   const auto &animations = ctx.registry().animations;
   auto modelview_mat = mesh.mat;
+  if (ctx.registry().cars.count(id))
+    modelview_mat = Car::transform(ctx, id);
   if (animations.count(id))
     modelview_mat = modelview_mat * animations.at(id).mat;
-  set_modelview_mat(ctx, modelview_mat);
-  set_normal_mapping_on(ctx, ctx.registry().normal_mapping_on);
-  render_single(ctx, mesh);
+  enqueue(ctx, id, mesh, modelview_mat);
   render_children(ctx, id, modelview_mat);
 }
 
-void Render::render_single(ecs::Context<Registry> &ctx,
-                           const components::Mesh &mesh) {
-  const auto &model = ctx.registry().models[mesh.model_index];
-  const auto &texture = ctx.registry().textures[mesh.texture_index];
-  const auto &vao_id = model.vao_id;
-  const auto &texture_id = texture.texture_id;
-  glBindVertexArray(vao_id);
-  set_uniform_int(ctx, "texture_sampler", 0);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture_id);
-  if (ctx.registry().program_index == Registry::PHONG_SHADER) {
-    const auto normal = ctx.registry().textures[mesh.normal_index];
-    set_uniform_int(ctx, "normal_sampler", 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normal.texture_id);
-    set_uniform_int(
-        ctx, "normal_mapping_on",
-        ctx.registry().normal_mapping_on &&
-            mesh.normal_index !=
-                ctx.registry().texture_indicies["empty_normal.png"]);
-  }
-  glDrawElements(GL_TRIANGLES, model.index_count, GL_UNSIGNED_INT, nullptr);
-  glBindVertexArray(0);
-}
-
-void Render::set_uniform_float(ecs::Context<Registry> &ctx, const char *name,
-                               float value) {
-  const auto program_index = ctx.registry().program_index;
-  const auto shader_program = ctx.registry().shader_programs[program_index];
-  const auto location = glGetUniformLocation(shader_program.program_id, name);
-  glUniform1f(location, value);
-}
-
-void Render::set_uniform_int(ecs::Context<Registry> &ctx, const char *name,
-                             int value) {
-  const auto program_index = ctx.registry().program_index;
-  const auto shader_program = ctx.registry().shader_programs[program_index];
-  const auto location = glGetUniformLocation(shader_program.program_id, name);
-  glUniform1i(location, value);
-}
-
-void Render::set_uniform_vec3(ecs::Context<Registry> &ctx, const char *name,
-                              const glm::vec3 &value) {
-  const auto program_index = ctx.registry().program_index;
-  const auto shader_program = ctx.registry().shader_programs[program_index];
-  const auto location = glGetUniformLocation(shader_program.program_id, name);
-  glUniform3fv(location, 1, glm::value_ptr(value));
-}
-
-void Render::set_light_pos(ecs::Context<Registry> &ctx, const glm::vec3 &pos) {
-  set_uniform_vec3(ctx, "light_pos", pos);
-}
-
-void Render::set_directional_light(ecs::Context<Registry> &ctx,
-                                   const glm::vec3 &direction) {
-  set_uniform_vec3(ctx, "directional_light", direction);
-}
+void Render::rebuild_chunks(ecs::Context<Registry> &ctx) {
+  auto &registry = ctx.registry();
+  chunk_bounds.clear();
+  const auto merge = [&](int chunk, const BoundingBox3D &bounds) {
+    auto it = chunk_bounds.find(chunk);
+    if (it == chunk_bounds.end())
+      chunk_bounds[chunk] = bounds;
+    else
+      it->second = it->second.merge(bounds);
+  };
+  for (const auto &entry : registry.static_batcher.chunks)
+    merge(entry.first, entry.second.bounds);
+  for (const auto &entry : registry.map_rows.rows) {
+    const auto chunk = row_chunk(entry.first);
+    for (const auto id : entry.second) {
+      if (!should_apply(ctx, id))
+        continue;
+      const auto &mesh = registry.meshes.at(id);
+      const auto &model = registry.models[mesh.model_index];
+      auto bounds = transform_bounds(model.bounding_box, mesh.mat);
+      extend_bounds(ctx, id, mesh.mat, bounds);
+      // Cars sweep their whole lane
+      if (registry.cars.count(id)) {
+        bounds.min_point[0] += LANE_MIN_X;
+        bounds.max_point[0] += LANE_MIN_X + LANE_LENGTH;
+      }
 
-void Render::set_ambient_intensity(ecs::Context<Registry> &ctx,
-                                   float intensity) {
-  set_uniform_float(ctx, "ambient_intensity", intensity);
+      merge(chunk, bounds);
+    }
+  }
+  chunk_version = registry.map_rows.version;
+  static_version = registry.static_batcher.version;
 }
 
-void Render::set_diffuse_intensity_point(ecs::Context<Registry> &ctx,
-                                         float intensity) {
-  set_uniform_float(ctx, "diffuse_intensity_point", intensity);
+void Render::extend_bounds(ecs::Context<Registry> &ctx,
+                           ecs::entities::EntityId id, const glm::mat4 &mat,
+                           BoundingBox3D &bounds) {
+  const auto &meshes = ctx.registry().meshes;
+  for (const auto child_id : ctx.entity_manager().entity_graph()[id].children) {
+    if (!meshes.count(child_id))
+      continue;
+    const auto &mesh = meshes.at(child_id);
+    const auto child_mat = mat * mesh.mat;
+    const auto child_bounds = transform_bounds(
+        ctx.registry().models[mesh.model_index].bounding_box, child_mat);
+    bounds.min_point = glm::min(bounds.min_point, child_bounds.min_point);
+    bounds.max_point = glm::max(bounds.max_point, child_bounds.max_point);
+    extend_bounds(ctx, child_id, child_mat, bounds);
+  }
 }
 
-void Render::set_specular_intensity_point(ecs::Context<Registry> &ctx,
-                                          float intensity) {
-  set_uniform_float(ctx, "specular_intensity_point", intensity);
-}
+void Render::enqueue(ecs::Context<Registry> &ctx,
+                     ecs::entities::EntityId id, const components::Mesh &mesh,
+                     const glm::mat4 &mat) {
+  const auto &model = ctx.registry().models[mesh.model_index];
+  const auto bounds = transform_bounds(model.bounding_box, mat);
+  auto &stats = ctx.registry().cull_stats;
+  stats.meshes_tested++;
+  if (!frustum.intersect_with(bounds)) {
+    stats.meshes_culled++;
+    return;
+  }
 
-void Render::set_diffuse_intensity_directional(ecs::Context<Registry> &ctx,
-                                               float intensity) {
-  set_uniform_float(ctx, "diffuse_intensity_directional", intensity);
+  const auto depth = glm::length(glm::vec3(mat[3]) - camera_pos);
+  // Bounding sphere radius over the visible half height at that distance
+  const auto radius = 0.5f * glm::length(bounds.max_point - bounds.min_point);
+  const auto screen_size =
+      radius / (glm::length(bounds.midpoint() - camera_pos) * tan_half_fovy);
+  const auto previous = lod_levels.find(id);
+  const auto lod = select_lod(
+      previous == lod_levels.end() ? 0 : previous->second, model.lods.size(),
+      screen_size);
+  next_lod_levels[id] = lod;
+  const auto program =
+      ctx.registry().program_index(features(ctx, mesh.normal_index, bounds));
+  const auto &arrays = ctx.registry().texture_arrays.array_indices;
+  render_queue.push(RenderKey::make(RenderKey::OPAQUE_PASS, program,
+                                    arrays[mesh.texture_index],
+                                    arrays[mesh.normal_index],
+                                    mesh.model_index, lod, depth),
+                    {mat, static_cast<GLuint>(mesh.texture_index),
+                     static_cast<GLuint>(mesh.normal_index)});
+}
+
+void Render::add_headlights(ecs::Context<Registry> &ctx,
+                            ecs::entities::EntityId id, const glm::mat4 &mat) {
+  // Models face +x; cars driving the other way are mirrored
+  const auto &bounds = ctx.registry().cars.at(id).model_bb;
+  const auto height = bounds.min_point.y +
+                      0.4f * (bounds.max_point.y - bounds.min_point.y);
+  const auto half_width = 0.3f * (bounds.max_point.z - bounds.min_point.z);
+  for (const auto side : {-half_width, half_width}) {
+    const PointLight light = {
+        glm::vec3(mat * glm::vec4(bounds.max_point.x + 0.1f, height,
+                                  bounds.midpoint().z + side, 1)),
+        components::Car::HEADLIGHT_RADIUS, glm::vec3(1.0f, 0.9f, 0.7f),
+        components::Car::HEADLIGHT_INTENSITY};
+    const auto reach = glm::vec3(light.radius);
+    if (frustum.intersect_with(
+            BoundingBox3D(light.pos - reach, light.pos + reach)))
+      point_lights.push_back(light);
+  }
 }
 
-void Render::set_specular_intensity_directional(ecs::Context<Registry> &ctx,
-                                                float intensity) {
-  set_uniform_float(ctx, "specular_intensity_directional", intensity);
-}
+void Render::submit(ecs::Context<Registry> &ctx) {
+  render_queue.sort();
+  bound_program = bound_texture = bound_normal = static_cast<std::size_t>(-1);
+  auto &profiler = ctx.registry().profiler;
+  profiler.begin_gpu("static");
+  submit_static(ctx);
+  profiler.end_gpu("static");
 
-void Render::set_uniform_mat4(ecs::Context<Registry> &ctx, const char *name,
-                              const glm::mat4 &value) {
-  const auto program_index = ctx.registry().program_index;
-  const auto shader_program = ctx.registry().shader_programs[program_index];
-  const auto location = glGetUniformLocation(shader_program.program_id, name);
-  glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+  profiler.begin_gpu("queue");
+  glBindVertexArray(ctx.registry().mesh_pool.vao_id);
+#ifndef __APPLE__
+  if (ctx.registry().indirect_draw)
+    submit_indirect(ctx);
+  else
+#endif
+    submit_direct(ctx);
+  glBindVertexArray(0);
+  profiler.end_gpu("queue");
+  render_queue.clear();
+}
+
+void Render::submit_static(ecs::Context<Registry> &ctx) {
+  auto &stats = ctx.registry().cull_stats;
+  const auto &arrays = ctx.registry().texture_arrays.array_indices;
+  for (const auto *chunk : visible_static) {
+    glBindVertexArray(chunk->vao_id);
+    for (std::size_t i = 0; i < chunk->batches.size(); i++) {
+      const auto &batch = chunk->batches[i];
+      const auto program = ctx.registry().program_index(
+          features(ctx, batch.normal_index, chunk->bounds));
+      bind_state(ctx, RenderKey::make(RenderKey::OPAQUE_PASS, program,
+                                      arrays[batch.texture_index],
+                                      arrays[batch.normal_index], 0, 0, 0));
+      // Each batch's texture slots sit in its own instance
+      MeshPool::bind_instance_layout(chunk->instance_buffer_id,
+                                     i * sizeof(Instance));
+      glDrawElementsInstancedBaseVertex(
+          GL_TRIANGLES, batch.range.index_count, GL_UNSIGNED_INT,
+          (void *)(batch.range.first_index * sizeof(GLuint)), 1,
+          batch.range.base_vertex);
+      stats.static_batches_drawn++;
+    }
+  }
+  visible_static.clear();
+}
+
+void Render::submit_direct(ecs::Context<Registry> &ctx) {
+  const auto &packets = render_queue.packets;
+  sorted_instances.clear();
+  for (const auto &packet : packets)
+    sorted_instances.push_back(render_queue.instances[packet.instance]);
+  const auto &pool = ctx.registry().mesh_pool;
+  glBindBuffer(GL_ARRAY_BUFFER, pool.instance_buffer_id);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * sorted_instances.size(),
+               sorted_instances.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  for (std::size_t first = 0, last; first < packets.size(); first = last) {
+    // Packets with identical state bits form one instanced draw
+    last = run_end(first);
+    const auto key = packets[first].key;
+    bind_state(ctx, key);
+    pool.bind_instances(pool.instance_buffer_id, first * sizeof(Instance));
+    const auto &range =
+        ctx.registry().models[RenderKey::model(key)].lods[RenderKey::lod(key)];
+    glDrawElementsInstancedBaseVertex(
+        GL_TRIANGLES, range.index_count, GL_UNSIGNED_INT,
+        (void *)(range.first_index * sizeof(GLuint)), last - first,
+        range.base_vertex);
+  }
 }
 
-void Render::set_projection_mat(ecs::Context<Registry> &ctx,
-                                const glm::mat4 &mat) {
-  set_uniform_mat4(ctx, "projection_mat", mat);
-}
+#ifndef __APPLE__
+void Render::submit_indirect(ecs::Context<Registry> &ctx) {
+  const auto &packets = render_queue.packets;
+  const auto &pool = ctx.registry().mesh_pool;
+  if (instance_ring.buffer_id == 0) {
+    instance_ring =
+        FrameRing(GL_ARRAY_BUFFER, INITIAL_RING_INSTANCES * sizeof(Instance));
+    command_ring = FrameRing(GL_DRAW_INDIRECT_BUFFER,
+                             INITIAL_RING_INSTANCES * sizeof(IndirectCommand));
+  }
+  // There is at most one command per instance
+  instance_ring.reserve(packets.size() * sizeof(Instance));
+  command_ring.reserve(packets.size() * sizeof(IndirectCommand));
+
+  auto *instances = static_cast<Instance *>(instance_ring.begin_frame());
+  auto *commands = static_cast<IndirectCommand *>(command_ring.begin_frame());
+  for (std::size_t i = 0; i < packets.size(); i++)
+    instances[i] = render_queue.instances[packets[i].instance];
+  // The attributes stay at the start of the ring and each command's base
+  // instance selects the frame's slot
+  pool.bind_instances(instance_ring.buffer_id, 0);
+  const auto base_instance = instance_ring.offset() / sizeof(Instance);
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_ring.buffer_id);
+  std::size_t command_count = 0, batch_first = 0;
+  std::uint64_t batch_key = 0;
+  // Draws can only be merged while the program and texture arrays stay the
+  // same
+  const auto flush = [&]() {
+    if (batch_first == command_count)
+      return;
+    bind_state(ctx, batch_key);
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES, GL_UNSIGNED_INT,
+        (void *)(command_ring.offset() + batch_first * sizeof(IndirectCommand)),
+        command_count - batch_first, 0);
+    batch_first = command_count;
+  };
+  for (std::size_t first = 0, last; first < packets.size(); first = last) {
+    last = run_end(first);
+    const auto key = packets[first].key;
+    if (RenderKey::program(key) != RenderKey::program(batch_key) ||
+        RenderKey::texture(key) != RenderKey::texture(batch_key) ||
+        RenderKey::normal(key) != RenderKey::normal(batch_key)) {
+      flush();
+      batch_key = key;
+    }
+    commands[command_count++] =
+        ctx.registry()
+            .models[RenderKey::model(key)]
+            .lods[RenderKey::lod(key)]
+            .command(last - first, base_instance + first);
+  }
+  flush();
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
-void Render::set_modelview_mat(ecs::Context<Registry> &ctx,
-                               const glm::mat4 &mat) {
-  set_uniform_mat4(ctx, "modelview_mat", mat);
+  instance_ring.end_frame();
+  command_ring.end_frame();
 }
+#endif
 
-void Render::set_uniform_boolean(ecs::Context<Registry> &ctx, const char *name,
-                                 bool value) {
-  const auto program_index = ctx.registry().program_index;
-  const auto shader_program = ctx.registry().shader_programs[program_index];
-  const auto location = glGetUniformLocation(shader_program.program_id, name);
-  glUniform1i(location, (int)value);
+std::size_t Render::run_end(std::size_t first) const {
+  const auto &packets = render_queue.packets;
+  const auto state = RenderKey::state(packets[first].key);
+  auto last = first;
+  while (last < packets.size() && RenderKey::state(packets[last].key) == state)
+    last++;
+  return last;
+}
+
+unsigned int Render::features(ecs::Context<Registry> &ctx,
+                              std::size_t normal_index,
+                              const BoundingBox3D &bounds) const {
+  unsigned int features = 0;
+  if (ctx.registry().normal_mapping_on && normal_index != empty_normal_index)
+    features |= NORMAL_MAP_FEATURE;
+  if (ctx.registry().diffuse_on)
+    features |= DIFFUSE_LIGHTING_FEATURE;
+  for (const auto &light : point_lights)
+    if (light.reaches(bounds)) {
+      features |= POINT_LIGHTS_FEATURE;
+      break;
+    }
+  return features;
 }
 
-void Render::set_diffuse_on(ecs::Context<Registry> &ctx, bool flag) {
-  set_uniform_boolean(ctx, "diffuse_on", flag);
+void Render::bind_state(ecs::Context<Registry> &ctx, std::uint64_t key) {
+  if (RenderKey::program(key) != bound_program) {
+    bound_program = RenderKey::program(key);
+    glUseProgram(ctx.registry().shader_programs[bound_program].program_id);
+  }
+  if (RenderKey::texture(key) != bound_texture) {
+    bound_texture = RenderKey::texture(key);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(
+        GL_TEXTURE_2D_ARRAY,
+        ctx.registry().texture_arrays.arrays[bound_texture].texture_id);
+  }
+  if (RenderKey::normal(key) != bound_normal) {
+    bound_normal = RenderKey::normal(key);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(
+        GL_TEXTURE_2D_ARRAY,
+        ctx.registry().texture_arrays.arrays[bound_normal].texture_id);
+  }
 }
 
-void Render::set_normal_mapping_on(ecs::Context<Registry> &ctx, bool flag) {
-  set_uniform_boolean(ctx, "normal_mapping_on", flag);
+// Sampler units never change, so every variant is set up once
+void Render::resolve_uniforms(ecs::Context<Registry> &ctx) {
+  program_uniforms.clear();
+  for (auto &shader_program : ctx.registry().shader_programs) {
+    Uniforms u;
+    u.texture_sampler = shader_program.uniform<int>("texture_sampler");
+    u.normal_sampler = shader_program.uniform<int>("normal_sampler");
+    u.light_sampler = shader_program.uniform<int>("light_sampler");
+    u.cluster_sampler = shader_program.uniform<int>("cluster_sampler");
+    u.light_index_sampler = shader_program.uniform<int>("light_index_sampler");
+    program_uniforms.push_back(u);
+
+    glUseProgram(shader_program.program_id);
+    shader_program.set(u.texture_sampler, 0);
+    shader_program.set(u.normal_sampler, 1);
+    shader_program.set(u.light_sampler, LIGHT_TEXTURE_UNIT);
+    shader_program.set(u.cluster_sampler, CLUSTER_TEXTURE_UNIT);
+    shader_program.set(u.light_index_sampler, LIGHT_INDEX_TEXTURE_UNIT);
+  }
 }
 
 void Render::render_children(ecs::Context<Registry> &ctx,
@@ -230,8 +605,7 @@ void Render::render_children(ecs::Context<Registry> &ctx,
     auto child_mat = base_mat * mesh.mat;
     if (animations.count(child_id))
       child_mat = child_mat * animations.at(child_id).mat;
-    set_projection_mat(ctx, child_mat);
-    render_single(ctx, mesh);
+    enqueue(ctx, child_id, mesh, child_mat);
     render_children(ctx, child_id, child_mat);
   }
 }
@@ -267,18 +641,100 @@ void InputHandler::update_single(ecs::Context<Registry> &ctx,
   }
 }
 
-bool Character::should_apply(ecs::Context<Registry> &ctx,
-                             ecs::entities::EntityId id) {
-  return ctx.registry().state == GameState::IN_PROGRESS &&
-         (ctx.registry().action_restrictions.count(id) ||
-          ctx.registry().win_zones.count(id) || ctx.registry().cars.count(id) ||
-          ctx.registry().shoe_items.count(id));
+void Character::update_all(ecs::Context<Registry> &ctx) {
+  // Static triggers fire from cell transitions and cars are queried through
+  // their lanes, so nothing is polled per entity
+  if (ctx.registry().state != GameState::IN_PROGRESS)
+    return;
+  update_cell(ctx);
+  check_traffic(ctx);
+}
+
+void Character::update_cell(ecs::Context<Registry> &ctx) {
+  auto &registry = ctx.registry();
+  const std::pair<int, int> cell = {registry.player_row, registry.player_col};
+  if (cell == registry.character_cell)
+    return;
+  exit_cell(ctx);
+  registry.character_cell = cell;
+  enter_cell(ctx, cell.first, cell.second);
 }
 
-void Character::pre_update(ecs::Context<Registry> &ctx) {
+void Character::enter_cell(ecs::Context<Registry> &ctx, int row, int col) {
+  auto &registry = ctx.registry();
+  for (const auto id : registry.triggers.at(row, col)) {
+    if (registry.action_restrictions.count(id)) {
+      const auto &action_restriction = registry.action_restrictions.at(id);
+      for (const auto &r : action_restriction.restrictions)
+        registry.blocked_actions[r] = registry.blocked_actions[r] ||
+                                      action_restriction.ignore_passthrough;
+    } else if (registry.win_zones.count(id)) {
+      if (registry.state != GameState::IN_PROGRESS)
+        continue;
+      registry.state = GameState::WIN;
+      std::cout << "YOU WIN!" << std::endl;
+    } else if (registry.shoe_items.count(id)) {
+      registry.remove_mesh(id);
+      registry.shoe_items.erase(id);
+      registry.map_rows.remove(id);
+      registry.triggers.remove(id);
+      // Activity would otherwise keep a dead id awake or asleep
+      auto &awake_ids = registry.awake_ids;
+      awake_ids.erase(std::remove(awake_ids.begin(), awake_ids.end(), id),
+                      awake_ids.end());
+      registry.sleep_times.erase(id);
+      ctx.entity_manager().remove_id(id);
+      auto &character = registry.characters[registry.character_id];
+      character.actions.push(components::ActionKind::WEAR_SHOE);
+    }
+  }
+}
+
+void Character::exit_cell(ecs::Context<Registry> &ctx) {
   ctx.registry().blocked_actions.clear();
 }
 
+void Character::check_traffic(ecs::Context<Registry> &ctx) {
+  if (ctx.registry().pass_through)
+    return;
+
+  const auto character_id = ctx.registry().character_id;
+  const auto &character_mesh = ctx.registry().meshes.at(character_id);
+  const auto &animation = ctx.registry().animations[character_id];
+  const auto character_bb =
+      ctx.registry().characters[character_id].model_bb.transform(
+          character_mesh.mat * animation.mat);
+
+  // Only the lanes whose rows overlap the character can hit it
+  const auto &lanes = ctx.registry().lanes;
+  const int row_lo = std::ceil(-character_bb.max_point[2] / STEP_SIZE - 0.5f),
+            row_hi = std::floor(-character_bb.min_point[2] / STEP_SIZE + 0.5f);
+  for (int row = std::max(row_lo, 0); row <= row_hi; row++) {
+    if (!lanes.count(row))
+      continue;
+    const auto candidates =
+        lanes.at(row).query(character_bb.min_point[0],
+                            character_bb.max_point[0], ctx.registry().sim_time);
+    for (const auto car_id : candidates) {
+      const auto &car = ctx.registry().cars[car_id];
+      const auto car_mat = Car::transform(ctx, car_id);
+      const auto car_bb = car.model_bb.transform(car_mat);
+      if (!character_bb.intersect_with(car_bb))
+        continue;
+      // Narrowphase against the actual triangles, in the car's model space
+      const auto &model =
+          ctx.registry().models[ctx.registry().meshes.at(car_id).model_index];
+      if (model.bvh.empty() ||
+          model.bvh.intersect_with(
+              character_bb.transform(glm::inverse(car_mat)))) {
+        ctx.registry().state = GameState::LOSE;
+        std::cout << "GAME OVER" << std::endl;
+        return;
+      }
+    }
+  }
+}
+
 void Character::post_update(ecs::Context<Registry> &ctx) {
   const auto character_id = ctx.registry().character_id;
   auto &character = ctx.registry().characters[character_id];
@@ -293,7 +749,8 @@ void Character::post_update(ecs::Context<Registry> &ctx) {
         ctx.registry().score = ctx.registry().player_row;
         std::cout << "Score: " << ctx.registry().score << std::endl;
       }
-      if (ctx.registry().map_top_generated > 256) {
+      if (!ctx.registry().map_generate_finished &&
+          ctx.registry().map_top_generated > 256) {
         ctx.registry().map_generate_finished = true;
         create_map_finish(ctx);
       }
@@ -307,15 +764,19 @@ void Character::post_update(ecs::Context<Registry> &ctx) {
       break;
     case components::ActionKind::MOVE_LEFT:
       mesh.mat *= glm::translate(glm::mat4(1), glm::vec3(-STEP_SIZE, 0, 0));
+      ctx.registry().player_col--;
       break;
     case components::ActionKind::MOVE_RIGHT:
       mesh.mat *= glm::translate(glm::mat4(1), glm::vec3(STEP_SIZE, 0, 0));
+      ctx.registry().player_col++;
       break;
     default:
       break;
     }
     Animation::disable(ctx, character_id);
     Animation::reset(ctx, character_id);
+    if (ctx.registry().state == GameState::IN_PROGRESS)
+      update_cell(ctx);
   }
   if (character.actions.empty() ||
       animation.state == components::AnimationState::RUNNING)
@@ -323,7 +784,9 @@ void Character::post_update(ecs::Context<Registry> &ctx) {
 
   const auto action = character.actions.front();
   character.actions.pop();
-  if (ctx.registry().blocked_actions.count(action))
+  const auto &blocked_actions = ctx.registry().blocked_actions;
+  if (blocked_actions.count(action) &&
+      (!ctx.registry().pass_through || blocked_actions.at(action)))
     return;
 
   const auto duration = components::Character::DEFAULT_ANIMATION_DURATION /
@@ -375,80 +838,20 @@ void Character::post_update(ecs::Context<Registry> &ctx) {
     character.current_action = action;
 }
 
-void Character::update_single(ecs::Context<Registry> &ctx,
-                              ecs::entities::EntityId id) {
-  const auto &action_restrictions = ctx.registry().action_restrictions;
-  const auto &win_zones = ctx.registry().win_zones;
-  const auto character_id = ctx.registry().character_id;
-  auto &meshes = ctx.registry().meshes;
-  const auto &character_mesh = meshes.at(character_id);
-  const auto &animation = ctx.registry().animations[character_id];
-  const auto character_center =
-      character_mesh.mat * animation.mat * glm::vec4(0, 0, 0, 1);
-  const auto character_bb =
-      ctx.registry().characters[character_id].model_bb.transform(
-          character_mesh.mat * animation.mat);
-  auto &shoe_items = ctx.registry().shoe_items;
-
-  if (action_restrictions.count(id)) {
-    const auto action_restriction = action_restrictions.at(id);
-    if (ctx.registry().pass_through && !action_restriction.ignore_passthrough)
-      return;
-    if (character_bb.intersect_with(action_restriction.bounding_box)) {
-      for (const auto &r : action_restriction.restrictions)
-        ctx.registry().blocked_actions.insert(r);
-    }
-  } else if (win_zones.count(id)) {
-    const auto &win_zone = win_zones.at(id);
-    if (character_bb.contained_in(win_zone.bounding_box)) {
-      ctx.registry().state = GameState::WIN;
-      std::cout << "YOU WIN!" << std::endl;
-    }
-  } else if (shoe_items.count(id)) {
-    const auto &shoe_item = shoe_items[id];
-    const auto &shoe_mesh = meshes.at(id);
-    const auto shoe_item_bb = shoe_item.model_bb.transform(shoe_mesh.mat);
-    if (!shoe_item_bb.intersect_with(character_bb))
-      return;
-    meshes.erase(id);
-    shoe_items.erase(id);
-    ctx.entity_manager().remove_id(id);
-    auto &character = ctx.registry().characters[character_id];
-    character.actions.push(components::ActionKind::WEAR_SHOE);
-  } else if (!ctx.registry().pass_through) {
-    const auto &car = ctx.registry().cars[id];
-    const auto &car_mesh = meshes.at(id);
-    const auto car_bb = car.model_bb.transform(car_mesh.mat);
-    if (character_bb.intersect_with(car_bb)) {
-      ctx.registry().state = GameState::LOSE;
-      std::cout << "GAME OVER" << std::endl;
-    }
-  }
-}
-
-bool Car::should_apply(ecs::Context<Registry> &ctx,
-                       ecs::entities::EntityId id) {
-  return ctx.registry().state == GameState::IN_PROGRESS &&
-         ctx.registry().cars.count(id);
+void Car::operator()(ecs::Context<Registry> &ctx) {
+  // Car positions are a closed-form function of the simulation clock, so
+  // advancing the clock is all the per-frame work traffic needs.
+  if (ctx.registry().state == GameState::IN_PROGRESS)
+    ctx.registry().sim_time += ctx.delta_time();
 }
 
-void Car::update_single(ecs::Context<Registry> &ctx,
-                        ecs::entities::EntityId id) {
-  auto &meshes = ctx.registry().meshes;
-  auto &mesh = meshes[id];
-  auto &car = ctx.registry().cars[id];
-  const auto car_bb = car.model_bb.transform(mesh.mat);
-  const auto xmin = car_bb.min_point[0], xmax = car_bb.max_point[0];
-  if (car.vel[0] < 0.0f && xmax < -STEP_SIZE * GRID_SIZE * 2.0)
-    mesh.mat = glm::translate(glm::mat4(1),
-                              glm::vec3(3.0 * GRID_SIZE * STEP_SIZE, 0, 0)) *
-               mesh.mat;
-  else if (car.vel[0] > 0.0f && xmin > STEP_SIZE * GRID_SIZE * 1.0)
-    mesh.mat = glm::translate(glm::mat4(1),
-                              glm::vec3(-3.0 * GRID_SIZE * STEP_SIZE, 0, 0)) *
-               mesh.mat;
-  const auto disp = ctx.delta_time() * car.vel;
-  mesh.mat = glm::translate(glm::mat4(1), disp) * mesh.mat;
+glm::mat4 Car::transform(ecs::Context<Registry> &ctx,
+                         ecs::entities::EntityId id) {
+  const auto &car = ctx.registry().cars.at(id);
+  const auto &lane = ctx.registry().lanes.at(car.row_index);
+  const auto pos_x = lane.position(car.phase, ctx.registry().sim_time);
+  return glm::translate(glm::mat4(1), glm::vec3(pos_x, 0, 0)) *
+         ctx.registry().meshes.at(id).mat;
 }
 
 glm::mat4 Animation::interpolate_transforms(float ratio, const glm::mat4 &first,
@@ -525,4 +928,13 @@ void Animation::disable(ecs::Context<Registry> &ctx,
   auto &animation = ctx.registry().animations[id];
   animation.info.kind = components::AnimationKind::DISABLED;
 }
+
+void Animation::fast_forward(ecs::Context<Registry> &ctx,
+                             ecs::entities::EntityId id, float duration) {
+  // Keyframes are sampled from the elapsed time alone, so skipping ahead is
+  // the same as having ticked through the whole interval.
+  auto &animation = ctx.registry().animations[id];
+  if (animation.state == components::AnimationState::RUNNING)
+    animation.time_elapsed += duration;
+}
 } // namespace systems
@@ -1,28 +0,0 @@
-#include "texture.hpp"
-
-#ifdef __APPLE__
-#include <OpenGL/gl3.h>
-
-#define __gl_h_
-#include <GLUT/glut.h>
-#else
-#include <GL/glew.h>
-#include <GL/glut.h>
-#endif
-
-#include <cstdint>
-
-Texture::Texture(std::uint8_t *texture_data, int width, int height,
-                 int channel_count) {
-  glGenTextures(1, &texture_id);
-  glBindTexture(GL_TEXTURE_2D, texture_id);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                  GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0,
-               channel_count == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE,
-               texture_data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-}
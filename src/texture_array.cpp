@@ -0,0 +1,270 @@
+#include "texture_array.hpp"
+
+#include <glm/glm.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "texture.hpp"
+#include "uniform_buffer.hpp"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+struct Placement {
+  std::size_t image;
+  GLint layer;
+  int x, y;
+};
+
+int level_extent(int size, int level) { return std::max(1, size >> level); }
+
+// Bytes of one layer of a level, used when storage must be allocated level
+// by level
+std::size_t level_size(const TextureImage &image, int width, int height) {
+  if (!image.compressed)
+    return (image.format == GL_RG ? 2 : 4) * width * height;
+  const std::size_t block_bytes =
+      image.internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+  return block_bytes * ((width + 3) / 4) * ((height + 3) / 4);
+}
+
+// Mid grey, and a flat normal for BC5, repeated over a whole level
+std::vector<std::uint8_t> placeholder(const TextureImage &image, int width,
+                                      int height) {
+  std::vector<std::uint8_t> pattern;
+  if (!image.compressed)
+    pattern = {128, 128, 128, 255};
+  else if (image.internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+    pattern = {0x10, 0x84, 0x10, 0x84, 0, 0, 0, 0};
+  else if (image.internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+    pattern = {255, 255, 0, 0, 0, 0, 0, 0, 0x10, 0x84, 0x10, 0x84, 0, 0, 0, 0};
+  else
+    pattern = {128, 128, 0, 0, 0, 0, 0, 0, 128, 128, 0, 0, 0, 0, 0, 0};
+  std::vector<std::uint8_t> result(level_size(image, width, height));
+  for (std::size_t i = 0; i < result.size(); i++)
+    result[i] = pattern[i % pattern.size()];
+  return result;
+}
+
+// Shelf packing of images smaller than a layer, starting at first_layer.
+// Each image is aligned to the largest power of two not above its shorter
+// side, and at least a compressed block, so its mips stay aligned as far
+// down as its size allows.
+std::vector<Placement> pack_atlas(const std::vector<TextureImage> &images,
+                                  std::vector<std::size_t> members, int width,
+                                  int height, GLint first_layer) {
+  std::sort(members.begin(), members.end(),
+            [&](std::size_t a, std::size_t b) {
+              return images[a].height > images[b].height;
+            });
+  std::vector<Placement> placements;
+  GLint layer = first_layer;
+  int x = 0, y = 0, shelf_height = 0;
+  for (const auto i : members) {
+    const auto &image = images[i];
+    int align = 4;
+    while (2 * align <= std::min(image.width, image.height))
+      align *= 2;
+    x = (x + align - 1) / align * align;
+    if (x + image.width > width) {
+      x = 0;
+      y += shelf_height;
+      shelf_height = 0;
+    }
+    y = (y + align - 1) / align * align;
+    if (y + image.height > height) {
+      layer++;
+      x = y = shelf_height = 0;
+    }
+    placements.push_back({i, layer, x, y});
+    x += image.width;
+    shelf_height = std::max(shelf_height, image.height);
+  }
+  return placements;
+}
+} // namespace
+
+void TextureArrays::build(const std::vector<TextureImage> &images) {
+  if (images.size() > MAX_TEXTURE_SLOTS)
+    throw std::runtime_error("too many textures for the slot table");
+  arrays.clear();
+  array_indices.assign(images.size(), 0);
+  slots.assign(images.size(), TextureSlot{});
+  placements.assign(images.size(), TexturePlacement{});
+
+  // One array per upload format
+  std::vector<std::vector<std::size_t>> groups;
+  for (std::size_t i = 0; i < images.size(); i++) {
+    auto it = std::find_if(groups.begin(), groups.end(),
+                           [&](const std::vector<std::size_t> &group) {
+                             const auto &first = images[group.front()];
+                             return first.internal_format ==
+                                        images[i].internal_format &&
+                                    first.format == images[i].format;
+                           });
+    if (it == groups.end())
+      groups.emplace_back(1, i);
+    else
+      it->push_back(i);
+  }
+
+#ifdef __APPLE__
+  const bool immutable = false;
+#else
+  const bool immutable = GLEW_ARB_texture_storage;
+#endif
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (const auto &group : groups) {
+    const auto &sample = images[group.front()];
+    TextureArray array;
+    array.internal_format = sample.internal_format;
+    for (const auto i : group) {
+      array.width = std::max(array.width, images[i].width);
+      array.height = std::max(array.height, images[i].height);
+    }
+    array.level_count = 1;
+    while ((std::max(array.width, array.height) >> array.level_count) > 0)
+      array.level_count++;
+
+    std::vector<Placement> group_placements;
+    std::vector<std::size_t> atlased;
+    for (const auto i : group) {
+      if (images[i].width == array.width && images[i].height == array.height)
+        group_placements.push_back(
+            {i, static_cast<GLint>(group_placements.size()), 0, 0});
+      else
+        atlased.push_back(i);
+    }
+    const auto atlas_placements =
+        pack_atlas(images, atlased, array.width, array.height,
+                   static_cast<GLint>(group_placements.size()));
+    group_placements.insert(group_placements.end(), atlas_placements.begin(),
+                            atlas_placements.end());
+    for (const auto &placement : group_placements)
+      array.layer_count = std::max(array.layer_count, placement.layer + 1);
+
+    glGenTextures(1, &array.texture_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture_id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                    array.level_count - 1);
+    if (immutable) {
+      glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.level_count,
+                     array.internal_format, array.width, array.height,
+                     array.layer_count);
+    } else {
+      for (GLint level = 0; level < array.level_count; level++) {
+        const auto width = level_extent(array.width, level),
+                   height = level_extent(array.height, level);
+        if (sample.compressed)
+          glCompressedTexImage3D(
+              GL_TEXTURE_2D_ARRAY, level, array.internal_format, width, height,
+              array.layer_count, 0,
+              level_size(sample, width, height) * array.layer_count, nullptr);
+        else
+          glTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.internal_format,
+                       width, height, array.layer_count, 0, sample.format,
+                       GL_UNSIGNED_BYTE, nullptr);
+      }
+    }
+
+    arrays.push_back(array);
+
+    const int block = sample.compressed ? 4 : 1;
+    for (const auto &placement : group_placements) {
+      const auto &image = images[placement.image];
+      // Atlased levels are uploaded while they stay block aligned
+      GLint level_count = 0;
+      while (level_count < static_cast<GLint>(image.levels.size())) {
+        const auto step = block << level_count;
+        const bool whole = image.width == array.width &&
+                           image.height == array.height;
+        if (!whole && (placement.x % step || placement.y % step ||
+                       image.width % step || image.height % step))
+          break;
+        level_count++;
+      }
+      placements[placement.image] = {placement.layer, placement.x,
+                                     placement.y, level_count};
+      array_indices[placement.image] = arrays.size() - 1;
+      GLint min_level = level_count;
+      for (GLint level = level_count - 1; level >= 0; level--) {
+        const auto &data = image.levels[level];
+        if (data.empty())
+          continue;
+        upload(placement.image, image, level, 0,
+               level_extent(image.height, level), data.data());
+        min_level = level;
+      }
+      if (min_level == level_count && level_count > 0) {
+        min_level = level_count - 1;
+        upload(placement.image, image, min_level, 0,
+               level_extent(image.height, min_level),
+               placeholder(image, level_extent(image.width, min_level),
+                           level_extent(image.height, min_level))
+                   .data());
+      }
+
+      auto &slot = slots[placement.image];
+      slot.uv_rect = glm::vec4(float(placement.x) / array.width,
+                               float(placement.y) / array.height,
+                               float(image.width) / array.width,
+                               float(image.height) / array.height);
+      slot.layer = placement.layer;
+      slot.max_level = std::max(level_count - 1, 0);
+      slot.min_level = std::min<float>(min_level, slot.max_level);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  slot_uniforms = UniformBuffer(TEXTURE_SLOT_UNIFORM_BINDING,
+                                sizeof(TextureSlot) * MAX_TEXTURE_SLOTS);
+  update_slots();
+}
+
+void TextureArrays::upload(std::size_t texture, const TextureImage &image,
+                           GLint level, int y, int height,
+                           const void *data) const {
+  const auto &placement = placements[texture];
+  const auto x = placement.x >> level;
+  const auto width = level_extent(image.width, level);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,
+                arrays[array_indices[texture]].texture_id);
+  if (image.compressed)
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x,
+                              (placement.y >> level) + y, placement.layer,
+                              width, height, 1, image.internal_format,
+                              level_size(image, width, height), data);
+  else
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x, (placement.y >> level) + y,
+                    placement.layer, width, height, 1, image.format,
+                    GL_UNSIGNED_BYTE, data);
+}
+
+void TextureArrays::update_slots() {
+  auto table = slots;
+  table.resize(MAX_TEXTURE_SLOTS);
+  slot_uniforms.update(table.data());
+}
@@ -0,0 +1,294 @@
+#include "texture_cache.hpp"
+
+#include <stb_image.h>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "file_util.hpp"
+#include "texture.hpp"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+const std::uint32_t CACHE_MAGIC = 0x58545043; // "CPTX"
+// Bumped whenever the encoded output changes, so old files are rebuilt
+const std::uint32_t CACHE_VERSION = 2;
+
+// Maps each texel's xyz back to unit length after filtering
+void renormalize(std::vector<std::uint8_t> &pixels) {
+  for (std::size_t i = 0; i < pixels.size(); i += 4) {
+    float n[3], length = 0;
+    for (int c = 0; c < 3; c++) {
+      n[c] = pixels[i + c] / 255.0f * 2 - 1;
+      length += n[c] * n[c];
+    }
+    length = std::sqrt(length);
+    for (int c = 0; c < 3; c++) {
+      const auto value = length > 0 ? n[c] / length : (c == 2 ? 1.0f : 0.0f);
+      pixels[i + c] =
+          static_cast<std::uint8_t>(std::lround((value * 0.5f + 0.5f) * 255));
+    }
+  }
+}
+
+// 4x4 blocks of 8 or 16 bytes; edges of small levels repeat their last
+// texel
+std::vector<std::uint8_t> compress(const std::vector<std::uint8_t> &pixels,
+                                   int width, int height, GLenum format) {
+  const auto block_size = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+  const auto blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+  std::vector<std::uint8_t> result(block_size * blocks_x * blocks_y);
+  auto *target = result.data();
+  std::uint8_t rgba[64], rg[32];
+  for (int by = 0; by < blocks_y; by++)
+    for (int bx = 0; bx < blocks_x; bx++) {
+      for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++) {
+          const auto sx = std::min(4 * bx + x, width - 1),
+                     sy = std::min(4 * by + y, height - 1);
+          const auto *texel = &pixels[4 * (sy * width + sx)];
+          const auto k = 4 * y + x;
+          std::copy(texel, texel + 4, &rgba[4 * k]);
+          rg[2 * k] = texel[0];
+          rg[2 * k + 1] = texel[1];
+        }
+      if (format == GL_COMPRESSED_RG_RGTC2)
+        stb_compress_bc5_block(target, rg);
+      else
+        stb_compress_dxt_block(target, rgba,
+                               format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                               STB_DXT_HIGHQUAL);
+      target += block_size;
+    }
+  return result;
+}
+
+// Chosen from the header alone, so that describe() agrees with build()
+void set_upload_format(TextureImage &image, TextureKind kind,
+                       int channel_count, bool s3tc_supported) {
+  const bool has_alpha = channel_count == 2 || channel_count == 4;
+  image.compressed = kind == TextureKind::NORMAL || s3tc_supported;
+  if (kind == TextureKind::NORMAL) {
+    image.internal_format = GL_COMPRESSED_RG_RGTC2;
+  } else if (s3tc_supported) {
+    image.internal_format = has_alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+                                      : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  } else {
+    image.internal_format = GL_RGBA8;
+    image.format = GL_RGBA;
+  }
+}
+} // namespace
+
+std::vector<std::uint8_t> downsample(const std::vector<std::uint8_t> &pixels,
+                                     int width, int height) {
+  const auto result_width = std::max(1, width / 2),
+             result_height = std::max(1, height / 2);
+  std::vector<std::uint8_t> result(4 * result_width * result_height);
+  for (int y = 0; y < result_height; y++) {
+    const auto *row0 = &pixels[4 * width * std::min(2 * y, height - 1)];
+    const auto *row1 = &pixels[4 * width * std::min(2 * y + 1, height - 1)];
+    auto *target = &result[4 * result_width * y];
+    int x = 0;
+#ifdef __SSE2__
+    // Four output texels per step: widen to 16 bits, add the two rows, then
+    // fold each texel pair into one
+    const auto zero = _mm_setzero_si128(), round = _mm_set1_epi16(2);
+    for (; x + 4 <= result_width && 2 * x + 8 <= width; x += 4) {
+      const auto a0 = _mm_loadu_si128((const __m128i *)(row0 + 8 * x)),
+                 a1 = _mm_loadu_si128((const __m128i *)(row0 + 8 * x + 16)),
+                 b0 = _mm_loadu_si128((const __m128i *)(row1 + 8 * x)),
+                 b1 = _mm_loadu_si128((const __m128i *)(row1 + 8 * x + 16));
+      const auto s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                                    _mm_unpacklo_epi8(b0, zero)),
+                 s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                                    _mm_unpackhi_epi8(b0, zero)),
+                 s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+                                    _mm_unpacklo_epi8(b1, zero)),
+                 s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+                                    _mm_unpackhi_epi8(b1, zero));
+      const auto lo = _mm_unpacklo_epi64(
+                     _mm_add_epi16(s0, _mm_srli_si128(s0, 8)),
+                     _mm_add_epi16(s1, _mm_srli_si128(s1, 8))),
+                 hi = _mm_unpacklo_epi64(
+                     _mm_add_epi16(s2, _mm_srli_si128(s2, 8)),
+                     _mm_add_epi16(s3, _mm_srli_si128(s3, 8)));
+      _mm_storeu_si128(
+          (__m128i *)(target + 4 * x),
+          _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, round), 2),
+                           _mm_srli_epi16(_mm_add_epi16(hi, round), 2)));
+    }
+#endif
+    for (; x < result_width; x++) {
+      const auto x0 = std::min(2 * x, width - 1),
+                 x1 = std::min(2 * x + 1, width - 1);
+      for (int c = 0; c < 4; c++)
+        target[4 * x + c] = (row0[4 * x0 + c] + row0[4 * x1 + c] +
+                             row1[4 * x0 + c] + row1[4 * x1 + c] + 2) /
+                            4;
+    }
+  }
+  return result;
+}
+
+TextureCache::TextureCache(const std::string &directory)
+    : directory(directory) {
+#ifdef __APPLE__
+  s3tc_supported = true;
+#else
+  s3tc_supported = GLEW_EXT_texture_compression_s3tc;
+#endif
+  make_directory(directory);
+  // Global in stb_image, so it is set once before any worker decodes
+  stbi_set_flip_vertically_on_load(true);
+}
+
+TextureImage TextureCache::describe(const std::string &filename,
+                                    TextureKind kind) const {
+  int width, height, channel_count;
+  if (!stbi_info(filename.c_str(), &width, &height, &channel_count))
+    throw std::runtime_error("texture load failed: " + filename);
+  TextureImage image;
+  image.width = width;
+  image.height = height;
+  set_upload_format(image, kind, channel_count, s3tc_supported);
+  std::size_t level_count = 1;
+  while ((std::max(width, height) >> level_count) > 0)
+    level_count++;
+  image.levels.resize(level_count);
+  return image;
+}
+
+TextureImage TextureCache::load(const std::string &filename,
+                                TextureKind kind) const {
+  std::string source;
+  if (!read_file(filename, source))
+    throw std::runtime_error("texture file read failed: " + filename);
+  const auto key = hash(hash(FNV_OFFSET_BASIS, source),
+                        std::to_string(CACHE_VERSION) + "/" +
+                            std::to_string(static_cast<int>(kind)) + "/" +
+                            std::to_string(s3tc_supported));
+  const auto cache_path = path(key);
+  TextureImage image;
+  if (read(cache_path, image))
+    return image;
+  image = build(std::vector<std::uint8_t>(source.begin(), source.end()),
+                filename, kind);
+  write(cache_path, image);
+  return image;
+}
+
+std::string TextureCache::path(std::uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.tex",
+                static_cast<unsigned long long>(key));
+  return directory + "/" + name;
+}
+
+bool TextureCache::read(const std::string &path, TextureImage &image) const {
+  std::ifstream infile(path, std::ios::binary);
+  if (!infile)
+    return false;
+  std::uint32_t header[8];
+  if (!infile.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION)
+    return false;
+  image.internal_format = header[2];
+  image.format = header[3];
+  image.compressed = header[4] != 0;
+  image.width = header[5];
+  image.height = header[6];
+  image.levels.resize(header[7]);
+  for (auto &level : image.levels) {
+    std::uint64_t size;
+    if (!infile.read(reinterpret_cast<char *>(&size), sizeof(size)))
+      return false;
+    level.resize(size);
+    if (!infile.read(reinterpret_cast<char *>(level.data()), size))
+      return false;
+  }
+  return !image.levels.empty();
+}
+
+void TextureCache::write(const std::string &path,
+                         const TextureImage &image) const {
+  std::ofstream outfile(path, std::ios::binary);
+  if (!outfile)
+    return;
+  const std::uint32_t header[8] = {CACHE_MAGIC,
+                                   CACHE_VERSION,
+                                   image.internal_format,
+                                   image.format,
+                                   image.compressed,
+                                   static_cast<std::uint32_t>(image.width),
+                                   static_cast<std::uint32_t>(image.height),
+                                   static_cast<std::uint32_t>(
+                                       image.levels.size())};
+  outfile.write(reinterpret_cast<const char *>(header), sizeof(header));
+  for (const auto &level : image.levels) {
+    const std::uint64_t size = level.size();
+    outfile.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    outfile.write(reinterpret_cast<const char *>(level.data()), size);
+  }
+}
+
+TextureImage TextureCache::build(const std::vector<std::uint8_t> &source,
+                                 const std::string &filename,
+                                 TextureKind kind) const {
+  int width, height, channel_count;
+  std::uint8_t *data = stbi_load_from_memory(
+      source.data(), source.size(), &width, &height, &channel_count, 4);
+  if (data == nullptr)
+    throw std::runtime_error("texture load failed: " + filename);
+  std::vector<std::uint8_t> pixels(data, data + 4 * width * height);
+  stbi_image_free(data);
+
+  TextureImage image;
+  image.width = width;
+  image.height = height;
+  set_upload_format(image, kind, channel_count, s3tc_supported);
+
+  while (true) {
+    if (kind == TextureKind::NORMAL)
+      renormalize(pixels);
+    image.levels.push_back(
+        image.compressed
+            ? compress(pixels, width, height, image.internal_format)
+            : pixels);
+    if (width == 1 && height == 1)
+      break;
+    pixels = downsample(pixels, width, height);
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+  return image;
+}
@@ -0,0 +1,198 @@
+#include "texture_streamer.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "asset_loader.hpp"
+#include "frame_ring.hpp"
+#include "texture.hpp"
+#include "texture_array.hpp"
+#include "texture_cache.hpp"
+
+namespace {
+int block_height(const TextureImage &image) { return image.compressed ? 4 : 1; }
+
+// Bytes of one row of blocks in a level
+std::size_t row_size(const TextureImage &image, GLint level) {
+  const auto height = std::max(1, image.height >> level);
+  const auto block = block_height(image);
+  return image.levels[level].size() / ((height + block - 1) / block);
+}
+} // namespace
+
+TextureStreamer::TextureStreamer(const TextureCache &cache,
+                                 const std::vector<TextureRequest> &requests,
+                                 const LoadProgress &progress)
+    : shared(std::make_shared<Shared>()), requests(requests),
+      progress(progress) {
+  shared->cache = cache;
+#ifndef __APPLE__
+  staging_supported = GLEW_ARB_buffer_storage;
+#endif
+  if (staging_supported)
+    staging = FrameRing(GL_PIXEL_UNPACK_BUFFER, TEXTURE_UPLOAD_BUDGET);
+}
+
+void TextureStreamer::request(std::size_t texture, AssetLoader &loader) {
+  total_count++;
+  auto state = shared;
+  const auto request = requests[texture];
+  // The first failure is kept for update() to rethrow on the GL thread
+  loader.submit([state, request, texture]() {
+    if (state->stop)
+      return;
+    Upload upload = {texture, request.filename, {}, 0, 0};
+    try {
+      upload.image = state->cache.load(request.filename, request.kind);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (!state->error)
+        state->error = std::current_exception();
+      state->ready.notify_all();
+      return;
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->decoded.push_back(std::move(upload));
+    state->ready.notify_all();
+  });
+}
+
+TextureStreamer::~TextureStreamer() {
+  if (shared)
+    shared->stop = true;
+}
+
+void TextureStreamer::update(TextureArrays &texture_arrays) {
+  if (!shared)
+    return;
+  take_decoded(texture_arrays);
+  if (uploads.empty())
+    return;
+
+  std::uint8_t *staged = nullptr;
+  std::size_t capacity = TEXTURE_UPLOAD_BUDGET;
+  if (staging_supported) {
+    staged = static_cast<std::uint8_t *>(staging.begin_frame());
+    capacity = staging.slot_size;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer_id);
+  }
+  send(texture_arrays, staged, capacity);
+  if (staged != nullptr) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    staging.end_frame();
+  }
+}
+
+void TextureStreamer::finish(TextureArrays &texture_arrays) {
+  if (!shared)
+    return;
+  while (true) {
+    take_decoded(texture_arrays);
+    // Straight from client memory, as no staging slot holds everything
+    send(texture_arrays, nullptr, std::numeric_limits<std::size_t>::max());
+    if (finished_count == total_count)
+      return;
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->ready.wait(lock, [this]() {
+      return shared->error || !shared->decoded.empty();
+    });
+  }
+}
+
+void TextureStreamer::take_decoded(const TextureArrays &texture_arrays) {
+  std::deque<Upload> decoded;
+  {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    if (shared->error)
+      std::rethrow_exception(shared->error);
+    decoded.swap(shared->decoded);
+  }
+  for (auto &upload : decoded) {
+    upload.level = texture_arrays.placements[upload.texture].level_count - 1;
+    // Nothing to send, but the texture still counts as finished
+    if (upload.level < 0) {
+      finished_count++;
+      if (progress)
+        progress(upload.filename, finished_count, total_count);
+      continue;
+    }
+    // Every row must fit in a slot, however wide the texture
+    if (staging_supported)
+      staging.reserve(row_size(upload.image, 0));
+    uploads.push_back(std::move(upload));
+  }
+}
+
+void TextureStreamer::send(TextureArrays &texture_arrays,
+                           std::uint8_t *staged, std::size_t capacity) {
+  if (uploads.empty())
+    return;
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  std::size_t used = 0;
+  bool slots_changed = false;
+  while (!uploads.empty()) {
+    auto &upload = uploads.front();
+    const auto &image = upload.image;
+    const auto block = block_height(image);
+    const auto height = std::max(1, image.height >> upload.level);
+    const auto size = row_size(image, upload.level);
+    const std::size_t first_row = upload.y / block,
+                      remaining_rows = (height + block - 1) / block - first_row;
+    auto row_count = std::min(remaining_rows, (capacity - used) / size);
+    // Without staging, a row wider than the budget still goes out alone
+    if (row_count == 0 && used == 0)
+      row_count = 1;
+    if (row_count == 0)
+      break;
+
+    const auto *source = image.levels[upload.level].data() + first_row * size;
+    const void *pixels = source;
+    if (staged != nullptr) {
+      std::memcpy(staged + used, source, row_count * size);
+      pixels = reinterpret_cast<const void *>(staging.offset() + used);
+    }
+    texture_arrays.upload(upload.texture, image, upload.level, upload.y,
+                          std::min<int>(row_count * block, height - upload.y),
+                          pixels);
+    used += row_count * size;
+    upload.y += row_count * block;
+    if (upload.y < height)
+      continue;
+
+    // Sampling may now reach the finished level
+    texture_arrays.slots[upload.texture].min_level = upload.level;
+    slots_changed = true;
+    upload.level--;
+    upload.y = 0;
+    if (upload.level < 0) {
+      finished_count++;
+      if (progress)
+        progress(upload.filename, finished_count, total_count);
+      uploads.pop_front();
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  if (slots_changed)
+    texture_arrays.update_slots();
+}
@@ -0,0 +1,39 @@
+#include "trigger_grid.hpp"
+
+#include "ecs/entities.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+std::int64_t TriggerGrid::cell_key(int row, int col) {
+  return (static_cast<std::int64_t>(row) << 32) ^
+         static_cast<std::uint32_t>(col);
+}
+
+void TriggerGrid::insert(ecs::entities::EntityId id, int row1, int col1,
+                         int row2, int col2) {
+  for (int row = std::min(row1, row2); row <= std::max(row1, row2); row++)
+    for (int col = std::min(col1, col2); col <= std::max(col1, col2); col++) {
+      const auto key = cell_key(row, col);
+      cells[key].push_back(id);
+      registrations[id].push_back(key);
+    }
+}
+
+void TriggerGrid::remove(ecs::entities::EntityId id) {
+  if (!registrations.count(id))
+    return;
+  for (const auto key : registrations[id]) {
+    auto &ids = cells[key];
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+  }
+  registrations.erase(id);
+}
+
+std::vector<ecs::entities::EntityId> TriggerGrid::at(int row, int col) const {
+  const auto it = cells.find(cell_key(row, col));
+  if (it == cells.end())
+    return {};
+  return it->second;
+}
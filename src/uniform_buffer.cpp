@@ -0,0 +1,31 @@
+#include "uniform_buffer.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cstddef>
+
+UniformBuffer::UniformBuffer(GLuint binding, std::size_t size)
+    : binding(binding), size(size) {
+  glGenBuffers(1, &buffer_id);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer_id);
+}
+
+void UniformBuffer::update(const void *data) {
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+  // Orphan the previous storage so the driver need not wait for draws that
+  // still read last frame's contents
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,91 @@
+#include "vertex_format.hpp"
+
+#include <glm/glm.hpp>
+
+#include <glm/gtc/packing.hpp>
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+
+#define __gl_h_
+#include <GLUT/glut.h>
+#else
+#include <GL/glew.h>
+#include <GL/glut.h>
+#endif
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+std::size_t position_size(PositionFormat format) {
+  return format == PositionFormat::HALF ? 4 * sizeof(std::uint16_t)
+                                        : 3 * sizeof(GLfloat);
+}
+
+template <typename T> void write(std::uint8_t *&target, const T &value) {
+  std::memcpy(target, &value, sizeof(value));
+  target += sizeof(value);
+}
+} // namespace
+
+PositionFormat position_format(const std::vector<MeshVertex> &vertices) {
+  for (const auto &vertex : vertices)
+    for (int i = 0; i < 3; i++)
+      if (std::abs(vertex.pos[i]) > HALF_POSITION_EXTENT)
+        return PositionFormat::FLOAT;
+  return PositionFormat::HALF;
+}
+
+std::size_t vertex_size(PositionFormat format) {
+  return position_size(format) + 3 * sizeof(std::uint32_t) +
+         2 * sizeof(std::uint16_t);
+}
+
+std::vector<std::uint8_t> pack_vertices(const std::vector<MeshVertex> &vertices,
+                                        PositionFormat format) {
+  std::vector<std::uint8_t> packed(vertex_size(format) * vertices.size());
+  auto *target = packed.data();
+  for (const auto &vertex : vertices) {
+    if (format == PositionFormat::HALF) {
+      write(target, glm::packHalf4x16(glm::vec4(vertex.pos, 1)));
+    } else {
+      for (int i = 0; i < 3; i++)
+        write(target, vertex.pos[i]);
+    }
+    write(target, glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0)));
+    const auto tangent = glm::vec3(vertex.tangent);
+    const auto length = glm::length(tangent);
+    write(target, glm::packSnorm3x10_1x2(glm::vec4(
+                      length > 0 ? tangent / length : tangent,
+                      vertex.tangent.w < 0 ? -1.0f : 1.0f)));
+    write(target, glm::packHalf2x16(vertex.uv));
+    write(target, static_cast<std::uint16_t>(vertex.material));
+    write(target, std::uint16_t(0));
+  }
+  return packed;
+}
+
+void bind_vertex_layout(PositionFormat format) {
+  const auto stride = vertex_size(format);
+  std::size_t offset = 0;
+  if (format == PositionFormat::HALF)
+    glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, stride, nullptr);
+  else
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
+  offset += position_size(format);
+  // Normal and tangent, the bitangent sign in the tangent's two-bit w
+  for (GLuint i = 1; i <= 2; i++) {
+    glVertexAttribPointer(i, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                          (void *)offset);
+    offset += sizeof(std::uint32_t);
+  }
+  glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void *)offset);
+  offset += sizeof(std::uint32_t);
+  glVertexAttribIPointer(4, 1, GL_UNSIGNED_SHORT, stride, (void *)offset);
+  for (GLuint i = 0; i <= 4; i++)
+    glEnableVertexAttribArray(i);
+}